@@ -383,6 +383,7 @@ wchar_t *utf8_to_wide (String str, s64 *out_length, Allocator allocator);
 
 String filename_get_full (String filename, Allocator allocator);
 String filename_get_parent_dir (String filename);
+bool create_directory (String path);    // Succeeds if the directory already exists
 
 // Array
 
@@ -686,6 +687,59 @@ s64 binary_search (const Slice<T> &slice, int (*pred) (const T &elem))
     return -1;
 }
 
+// Quick sort, falling back to insertion sort for small partitions
+template<typename T>
+void sort (Slice<T> slice, int (*compare) (const T &a, const T &b))
+{
+    while (slice.count > 16)
+    {
+        T pivot = slice.data[slice.count / 2];
+        s64 i = 0;
+        s64 j = slice.count - 1;
+        while (i <= j)
+        {
+            while (compare (slice.data[i], pivot) < 0)
+                i += 1;
+            while (compare (slice.data[j], pivot) > 0)
+                j -= 1;
+
+            if (i <= j)
+            {
+                T tmp = slice.data[i];
+                slice.data[i] = slice.data[j];
+                slice.data[j] = tmp;
+                i += 1;
+                j -= 1;
+            }
+        }
+
+        // Recurse on the smaller partition to bound the stack depth
+        if (j + 1 < slice.count - i)
+        {
+            sort (slice_make (j + 1, slice.data), compare);
+            slice = slice_make (slice.count - i, slice.data + i);
+        }
+        else
+        {
+            sort (slice_make (slice.count - i, slice.data + i), compare);
+            slice = slice_make (j + 1, slice.data);
+        }
+    }
+
+    for_range (i, 1, slice.count)
+    {
+        T elem = slice.data[i];
+        s64 j = i - 1;
+        while (j >= 0 && compare (slice.data[j], elem) > 0)
+        {
+            slice.data[j + 1] = slice.data[j];
+            j -= 1;
+        }
+
+        slice.data[j + 1] = elem;
+    }
+}
+
 // Hash map
 
 #define HASH_NEVER_OCCUPIED 0
@@ -1100,6 +1154,114 @@ f32 random_rangef (f32 low, f32 high)
     return random_rangef (&g_rng, low, high);
 }
 
+// Counter based random numbers (SplitMix64). The n-th number of a stream is the mix of
+// key + (n + 1) * gamma, so it only depends on the key and the counter: any number can
+// be computed directly, skipping ahead is free, and a stream keyed by coordinates gives
+// the same numbers no matter which thread asks for them or in which order.
+
+#define SPLITMIX64_GAMMA 0x9e3779b97f4a7c15
+
+struct Counter_RNG
+{
+    u64 key;
+    u64 counter;
+};
+
+inline
+u64 splitmix64_mix (u64 z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+
+    return z ^ (z >> 31);
+}
+
+// Derives a new key from a key and a value, e.g. a world seed and a coordinate
+inline
+u64 random_key_combine (u64 key, u64 value)
+{
+    return splitmix64_mix (key ^ splitmix64_mix (value + SPLITMIX64_GAMMA));
+}
+
+inline
+u64 random_key_combine (u64 key, s64 x, s64 y, s64 z)
+{
+    key = random_key_combine (key, cast (u64) x);
+    key = random_key_combine (key, cast (u64) y);
+
+    return random_key_combine (key, cast (u64) z);
+}
+
+inline
+u64 random_at (u64 key, u64 counter)
+{
+    return splitmix64_mix (key + (counter + 1) * SPLITMIX64_GAMMA);
+}
+
+// Maps the high 24 bits of a random number to [low, high)
+inline
+f32 random_to_rangef (u64 val, f32 low, f32 high)
+{
+    f32 t = (val >> 40) / cast (f32) F32_HIGHEST_REPRESENTABLE_INTEGER;
+
+    return low + t * (high - low);
+}
+
+inline
+void random_seed (Counter_RNG *rng, u64 key)
+{
+    rng->key = key;
+    rng->counter = 0;
+}
+
+inline
+u64 random_get (Counter_RNG *rng)
+{
+    u64 val = random_at (rng->key, rng->counter);
+    rng->counter += 1;
+
+    return val;
+}
+
+inline
+void random_skip (Counter_RNG *rng, s64 n)
+{
+    rng->counter += n;
+}
+
+inline
+u32 random_rangei (Counter_RNG *rng, u32 low, u32 high)
+{
+    // Multiply-shift instead of modulo, so the range does not favor the low values
+    u64 val = random_get (rng) >> 32;
+
+    return low + cast (u32) ((val * (high - low)) >> 32);
+}
+
+inline
+f32 random_rangef (Counter_RNG *rng, f32 low, f32 high)
+{
+    return random_to_rangef (random_get (rng), low, high);
+}
+
+// Fills results with the numbers first_counter to first_counter + count - 1 of the stream.
+// There is no dependency between iterations, so the compiler can vectorize the loop.
+inline
+void random_fill (u64 key, u64 first_counter, s64 count, u64 *results)
+{
+    u64 state = key + first_counter * SPLITMIX64_GAMMA;
+    for_range (i, 0, count)
+        results[i] = splitmix64_mix (state + cast (u64) (i + 1) * SPLITMIX64_GAMMA);
+}
+
+inline
+void random_fill_rangef (u64 key, u64 first_counter, s64 count, f32 low, f32 high, f32 *results)
+{
+    u64 state = key + first_counter * SPLITMIX64_GAMMA;
+    for_range (i, 0, count)
+        results[i] = random_to_rangef (splitmix64_mix (state + cast (u64) (i + 1) * SPLITMIX64_GAMMA), low, high);
+}
+
 // Platform layer
 
 void platform_init ();
@@ -1108,6 +1270,7 @@ String get_executable_path ();
 String get_error_string (u32 error_code);
 String get_last_error_string ();
 void sleep_milliseconds (u32 ms);
+int get_processor_count ();
 
 typedef s32 (*Thread_Proc) (struct Thread *);
 
@@ -40,6 +40,8 @@ extern "C"
         wchar_t **lpFilePart
     );
 
+    int CreateDirectoryW (const wchar_t *lpPathName, void *lpSecurityAttributes);
+
     u32 GetLastError ();
     u32 FormatMessageW (
         u32   dwFlags,
@@ -56,8 +58,30 @@ extern "C"
     );
 
     u32 timeBeginPeriod (u32 uPeriod);
+
+    void *CreateThread (
+        void *lpThreadAttributes,
+        u64   dwStackSize,
+        u32 (*lpStartAddress) (void *),
+        void *lpParameter,
+        u32   dwCreationFlags,
+        u32  *lpThreadId
+    );
+
+    u32 ResumeThread (void *hThread);
+    int TerminateThread (void *hThread, u32 dwExitCode);
+    int CloseHandle (void *hObject);
+    u32 WaitForSingleObject (void *hHandle, u32 dwMilliseconds);
+    u32 WaitForMultipleObjects (u32 nCount, void *const *lpHandles, int bWaitAll, u32 dwMilliseconds);
+    u32 GetActiveProcessorCount (u16 GroupNumber);
 }
 
+#define CREATE_SUSPENDED 0x00000004
+#define INFINITE 0xffffffff
+#define MAXIMUM_WAIT_OBJECTS 64
+#define ALL_PROCESSOR_GROUPS 0xffff
+#define ERROR_ALREADY_EXISTS 183
+
 void platform_init ()
 {
     // Enable virtual terminal sequences handling (otherwise we'll
@@ -181,6 +205,17 @@ String filename_get_full (String filename, Allocator allocator)
     return result;
 }
 
+bool create_directory (String path)
+{
+    wchar_t *wstr_path = utf8_to_wide (path, null, heap_allocator ());
+    defer (mem_free (wstr_path, heap_allocator ()));
+
+    if (!wstr_path)
+        return false;
+
+    return CreateDirectoryW (wstr_path, null) || GetLastError () == ERROR_ALREADY_EXISTS;
+}
+
 String get_error_string (u32 error_code)
 {
     static wchar_t error_wide_buffer[128];
@@ -219,3 +254,77 @@ void sleep_milliseconds (u32 ms)
 {
     Sleep (ms);
 }
+
+int get_processor_count ()
+{
+    return max (cast (int) GetActiveProcessorCount (ALL_PROCESSOR_GROUPS), 1);
+}
+
+static u32 thread_entry (void *param)
+{
+    Thread *thread = cast (Thread *) param;
+
+    return cast (u32) thread->proc (thread);
+}
+
+bool thread_init (Thread *thread, Thread_Proc proc, void *data, s64 starting_arena_size)
+{
+    thread->proc = proc;
+    thread->data = data;
+
+    if (!arena_init (&thread->thread_arena, starting_arena_size, heap_allocator ()))
+        return false;
+
+    thread->thread_allocator = arena_allocator (&thread->thread_arena);
+
+    u32 id;
+    thread->handle = CreateThread (null, 0, thread_entry, thread, CREATE_SUSPENDED, &id);
+    thread->id = cast (s32) id;
+
+    if (!thread->handle)
+    {
+        arena_reset (&thread->thread_arena);
+
+        return false;
+    }
+
+    return true;
+}
+
+void thread_cleanup (Thread *thread)
+{
+    CloseHandle (thread->handle);
+    thread->handle = null;
+
+    arena_reset (&thread->thread_arena);
+}
+
+void thread_start (Thread *thread)
+{
+    ResumeThread (thread->handle);
+}
+
+void thread_stop (Thread *thread)
+{
+    TerminateThread (thread->handle, 0);
+}
+
+void thread_wait (Thread *thread, s32 milliseconds)
+{
+    WaitForSingleObject (thread->handle, milliseconds < 0 ? INFINITE : cast (u32) milliseconds);
+}
+
+void thread_wait_multiple (Slice<Thread *> threads, s32 milliseconds)
+{
+    void *handles[MAXIMUM_WAIT_OBJECTS];
+
+    // Wait for all the threads, by groups of at most MAXIMUM_WAIT_OBJECTS
+    for (s64 i = 0; i < threads.count; i += MAXIMUM_WAIT_OBJECTS)
+    {
+        s64 count = min (threads.count - i, cast (s64) MAXIMUM_WAIT_OBJECTS);
+        for_range (j, 0, count)
+            handles[j] = threads[i + j]->handle;
+
+        WaitForMultipleObjects (cast (u32) count, handles, 1, milliseconds < 0 ? INFINITE : cast (u32) milliseconds);
+    }
+}
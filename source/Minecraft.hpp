@@ -14,8 +14,9 @@
 
 #include <stb_image.h>
 
-extern Arena     frame_arena;
-extern Allocator frame_allocator;
+// Per thread, so the generation code can run on worker threads that set up their own
+extern thread_local Arena     frame_arena;
+extern thread_local Allocator frame_allocator;
 
 extern Vec2f g_prev_mouse_pos;
 extern Vec2f g_mouse_delta;
@@ -30,10 +31,39 @@ extern s64 g_chunk_generation_samples;
 extern s64 g_chunk_creation_time;
 extern s64 g_chunk_creation_samples;
 extern s64 g_drawn_vertex_count;
+extern s64 g_occluded_chunk_count;
 extern s64 g_delta_time;    // In micro seconds
 
+// Per frame costs in micro seconds, used by the adaptive render distance controller
+extern s64 g_frame_work_time;   // Frame time without waiting for the buffer swap
+extern s64 g_frame_generation_time;
+extern s64 g_frame_meshing_time;
+extern s64 g_frame_draw_time;
+// Items actually processed during the frame, at most the streaming budgets below
+extern int g_frame_generated_chunk_count;
+extern int g_frame_meshed_chunk_count;
+extern int g_frame_far_terrain_tile_count;
+extern s64 g_chunk_meshing_time;
+extern s64 g_chunk_meshing_samples;
+extern s64 g_section_meshing_time;
+extern s64 g_section_meshing_samples;
+
 extern bool g_generate_new_chunks;
 extern int g_render_distance;
+extern bool g_occlusion_culling;
+extern int g_lod_distance;
+extern bool g_far_terrain_enabled;
+extern int g_far_terrain_distance;
+
+extern bool g_adaptive_render_distance;
+extern s64 g_target_frame_time;     // In micro seconds
+extern int g_min_render_distance;
+extern int g_max_render_distance;
+// Streaming budgets, in number of items processed per frame. 0 means no limit
+extern int g_chunk_generation_budget;
+extern int g_chunk_meshing_budget;
+static const int Default_Far_Terrain_Tiles_Per_Frame = 4;
+extern int g_far_terrain_tiles_per_frame;
 
 struct Vertex;
 struct Camera;
@@ -44,23 +74,67 @@ struct World;
 
 const int Perlin_Fractal_Max_Octaves = 10;
 
+enum Noise_Type : u8
+{
+    Noise_Type_Perlin,
+    Noise_Type_Simplex,
+
+    Noise_Type_Count,
+};
+
+static const char *Noise_Type_Names[Noise_Type_Count] = {"Perlin", "Simplex"};
+
 struct Perlin_Fractal_Params
 {
     f32 scale;
     int octaves;
     f32 persistance;
     f32 lacunarity;
+    Noise_Type noise_type;  // Perlin if not specified
 };
 
-f64 perlin_noise (f64 x, f64 y);
-f64 perlin_noise (f64 x, f64 y, f64 z);
+const int Perlin_Permutation_Size = 256;
+
+// Permutation of the lattice hashes. Each octave of each noise of a world has its own,
+// generated from the seed. The functions taking an array of permutations (one per octave)
+// use the reference permutation for all the octaves when it is null.
+struct Perlin_Permutation
+{
+    u8 values[Perlin_Permutation_Size * 2];
+};
+
+f64 perlin_noise (const Perlin_Permutation *permutation, f64 x, f64 y);
+f64 perlin_noise (const Perlin_Permutation *permutation, f64 x, f64 y, f64 z);
+f64 simplex_noise (const Perlin_Permutation *permutation, f64 x, f64 y);
+f64 simplex_noise (const Perlin_Permutation *permutation, f64 x, f64 y, f64 z);
 f64 perlin_fractal_max (int octaves, f64 persistance);
-f64 perlin_fractal_noise (f64 scale, int octaves, Vec2f *offsets, f64 persistance, f64 lacunarity, f64 x, f64 y);
-f64 perlin_fractal_noise (Perlin_Fractal_Params params, Vec2f *offsets, f64 x, f64 y);
-f64 perlin_fractal_noise (f64 scale, int octaves, Vec3f *offsets, f64 persistance, f64 lacunarity, f64 x, f64 y, f64 z);
-f64 perlin_fractal_noise (Perlin_Fractal_Params params, Vec3f *offsets, f64 x, f64 y, f64 z);
+f64 perlin_fractal_noise (f64 scale, int octaves, const Vec2f *offsets, const Perlin_Permutation *permutations, f64 persistance, f64 lacunarity, f64 x, f64 y, Noise_Type noise_type = Noise_Type_Perlin);
+f64 perlin_fractal_noise (Perlin_Fractal_Params params, const Vec2f *offsets, const Perlin_Permutation *permutations, f64 x, f64 y);
+f64 perlin_fractal_noise (f64 scale, int octaves, const Vec3f *offsets, const Perlin_Permutation *permutations, f64 persistance, f64 lacunarity, f64 x, f64 y, f64 z, Noise_Type noise_type = Noise_Type_Perlin);
+f64 perlin_fractal_noise (Perlin_Fractal_Params params, const Vec3f *offsets, const Perlin_Permutation *permutations, f64 x, f64 y, f64 z);
 void perlin_generate_offsets (LC_RNG *rng, int count, Vec2f *offsets);
 void perlin_generate_offsets (LC_RNG *rng, int count, Vec3f *offsets);
+void perlin_generate_permutations (Counter_RNG *rng, int count, Perlin_Permutation *permutations);
+
+enum Perlin_Simd_Level
+{
+    Perlin_Simd_None,
+    Perlin_Simd_SSE4,
+    Perlin_Simd_AVX2,
+};
+
+// Highest SIMD level the batched noise functions are allowed to use, the actual
+// level is also limited by what the CPU supports
+extern Perlin_Simd_Level g_perlin_simd_level;
+
+Perlin_Simd_Level perlin_simd_level ();
+const char *perlin_simd_level_name (Perlin_Simd_Level level);
+void perlin_fractal_noise_batch (Perlin_Fractal_Params params, const Vec2f *offsets, const Perlin_Permutation *permutations, s64 count, const f64 *xs, const f64 *ys, f64 *results);
+void perlin_fractal_noise_batch (Perlin_Fractal_Params params, const Vec2f *offsets, const Perlin_Permutation *permutations, s64 count, const f32 *xs, const f32 *ys, f32 *results);
+void perlin_fractal_noise_batch (Perlin_Fractal_Params params, const Vec3f *offsets, const Perlin_Permutation *permutations, s64 count, const f32 *xs, const f32 *ys, const f32 *zs, f32 *results);
+void perlin_fractal_noise_grid (Perlin_Fractal_Params params, const Vec2f *offsets, const Perlin_Permutation *permutations, f64 start_x, f64 start_y, int width, int height, f64 *results);
+void perlin_fractal_noise_grid (Perlin_Fractal_Params params, const Vec2f *offsets, const Perlin_Permutation *permutations, f32 start_x, f32 start_y, int width, int height, f32 *results);
+void perlin_benchmark (int grid_count);
 
 struct Nested_Hermite_Spline
 {
@@ -99,6 +173,31 @@ static f32 hermite_knot_value (const Nested_Hermite_Spline::Knot &knot, const Sl
     return knot.y;
 }
 
+// Flat version of a tree of Nested_Hermite_Spline, evaluated without pointer chasing.
+// Splines and knots are stored as structures of arrays, with the knots of a spline being
+// contiguous, and nested splines are referenced by index.
+struct Compiled_Hermite_Spline
+{
+    static const int Max_Splines = 60;
+    static const int Max_Knots = Max_Splines * Nested_Hermite_Spline::Max_Knots;
+
+    int spline_count;
+    s32 t_value_indices[Max_Splines];
+    s32 first_knots[Max_Splines];
+    s32 knot_counts[Max_Splines];
+
+    int knot_count;
+    f32 knot_x[Max_Knots];
+    f32 knot_y[Max_Knots];
+    f32 knot_derivatives[Max_Knots];
+    s32 knot_children[Max_Knots];   // Index of the nested spline, -1 if the knot has a constant value
+};
+
+bool hermite_spline_compile (const Nested_Hermite_Spline *root, Compiled_Hermite_Spline *compiled);
+f32 hermite_spline_evaluate (const Compiled_Hermite_Spline *spline, const f32 *t_values, int spline_index = 0);
+void hermite_spline_evaluate_batch (const Compiled_Hermite_Spline *spline, const f32 *const *t_values, s64 count, f32 *results);
+void hermite_spline_benchmark (World *world, int chunk_count);
+
 struct Image
 {
     s32 width;
@@ -116,6 +215,7 @@ struct Camera
     Vec2f rotation_input;
 
     f32 fov;
+    f32 aspect_ratio;
 
     Mat4f transform;
     Mat4f view_matrix;
@@ -125,6 +225,9 @@ struct Camera
 
 extern Camera g_camera;
 
+static const f32 Camera_Near_Plane = 0.01f;
+static const f32 Block_Edit_Reach = 8;    // How far from the camera blocks can be broken or placed
+
 void update_flying_camera (Camera *camera);
 
 enum Block_Face : u8
@@ -174,6 +277,10 @@ enum Block_Type : u8
     Block_Type_Stone,
     Block_Type_Bedrock,
     Block_Type_Water,
+    Block_Type_Log,
+    Block_Type_Leaves,
+    Block_Type_Coal_Ore,
+    Block_Type_Iron_Ore,
 
     Block_Type_Count,
 };
@@ -185,14 +292,32 @@ struct Block
 
 static const Block Block_Air = {};
 
+inline
+u16 block_type_bit (Block_Type type)
+{
+    return cast (u16) (1 << type);
+}
+
+// Heightmaps give the highest block of each column, skipping different types of blocks
+enum Heightmap_Type : u8
+{
+    Heightmap_World_Surface,    // Skips air
+    Heightmap_Solid_Surface,    // Skips air and water
+    Heightmap_Ocean_Floor,      // Skips air, water and trees
+
+    Heightmap_Count,
+};
+
 static const int Chunk_Size = 16;
 static const int Chunk_Height = 384;
+static const int Chunk_Section_Height = 16;
+static const int Chunk_Section_Count = Chunk_Height / Chunk_Section_Height;
 
 static const Vec2i Default_Height_Range = {100,300};
 
-static const Perlin_Fractal_Params Default_Continentalness_Perlin_Params = { 0.001340, 3, 0.25, 1.3 };
-static const Perlin_Fractal_Params Default_Erosion_Perlin_Params = { 0.002589, 5, 0.5, 1.5 };
-static const Perlin_Fractal_Params Default_Weirdness_Perlin_Params = { 0.033, 3, 0.5, 1.8 };
+static const Perlin_Fractal_Params Default_Continentalness_Perlin_Params = { 0.001340, 3, 0.25, 1.3, Noise_Type_Perlin };
+static const Perlin_Fractal_Params Default_Erosion_Perlin_Params = { 0.002589, 5, 0.5, 1.5, Noise_Type_Perlin };
+static const Perlin_Fractal_Params Default_Weirdness_Perlin_Params = { 0.033, 3, 0.5, 1.8, Noise_Type_Perlin };
 
 static const Perlin_Fractal_Params Default_Perlin_Params[3] = {
     Default_Continentalness_Perlin_Params,
@@ -201,6 +326,13 @@ static const Perlin_Fractal_Params Default_Perlin_Params[3] = {
 };
 
 static const int Default_Water_Level = 126;
+
+// 3D density terrain: a block is solid where surface_level - y + density_amplitude * noise >= 0,
+// with the normalized 3D noise sampled on a lattice of cells and trilinearly interpolated
+static const Perlin_Fractal_Params Default_Density_Perlin_Params = { 0.02, 3, 0.5, 2, Noise_Type_Perlin };
+static const f32 Default_Density_Amplitude = 24;   // In blocks
+static const int Density_Cell_Size = 4;
+static const int Density_Cell_Height = 8;
 static const f64 Surface_Dirt_Height = 8;
 
 enum Terrain_Value
@@ -230,6 +362,19 @@ struct Terrain_Values
     f32 surface_level;
 };
 
+// Trades quality for speed when generating the terrain values of chunks. The coarse modes
+// evaluate the noise and the surface spline on a lattice aligned to the world, so it is
+// shared across chunk borders, and interpolate the columns in between.
+enum Terrain_Sampling : u8
+{
+    Terrain_Sampling_Full,
+    Terrain_Sampling_Bilinear,
+    Terrain_Sampling_Bicubic,
+    Terrain_Sampling_Count,
+};
+
+static const int Default_Terrain_Sample_Step = 4;
+
 struct Terrain_Params
 {
     Perlin_Fractal_Params noise[3] = {
@@ -241,6 +386,14 @@ struct Terrain_Params
     Vec2i height_range = Default_Height_Range;
     int water_level = Default_Water_Level;
 
+    Terrain_Sampling sampling = Terrain_Sampling_Full;
+    int sample_step = Default_Terrain_Sample_Step;    // Lattice spacing of the coarse modes, has to divide Chunk_Size
+    bool bake_surface_spline = false;   // Sample the surface spline from World.surface_spline_lut
+
+    bool density_terrain = false;
+    Perlin_Fractal_Params density_noise = Default_Density_Perlin_Params;
+    f32 density_amplitude = Default_Density_Amplitude;
+
     Nested_Hermite_Spline *surface_spline;
     Static_Array<Nested_Hermite_Spline, 60> spline_stack;
 };
@@ -254,6 +407,36 @@ enum Chunk_Mesh_Type : u8
     Chunk_Mesh_Count,
 };
 
+// Chunks are generated one stage at a time. Some stages require the 4 neighbours to
+// have reached a previous stage (see chunk_stage_neighbour_requirement), so chunks
+// around the ones that are drawn are only generated as far as needed.
+enum Chunk_Stage : u8
+{
+    Chunk_Stage_Empty,
+    Chunk_Stage_Terrain_Values,
+    Chunk_Stage_Blocks,
+    Chunk_Stage_Surface,
+    Chunk_Stage_Features,
+    Chunk_Stage_Light,
+    Chunk_Stage_Mesh,       // Done by world_draw_chunks, that owns the GL work
+
+    Chunk_Stage_Count,
+};
+
+// Block written by a feature. Features are placed by the chunk their origin is in. The edits
+// falling in a neighbour are kept by the source chunk in Chunk.outgoing_edits and applied by
+// the neighbour at its light stage, once all of its neighbours have placed their features.
+struct Feature_Edit
+{
+    s16 x, y, z;            // Relative to the chunk the edit is applied to
+    Block_Type type;
+    u16 replaceable_types;  // Mask of (1 << type) of the blocks the edit can replace
+};
+
+// Features do not extend more than this many blocks from the chunk they are placed by
+const int Feature_Max_Reach = 4;
+const int Chunk_Neighbour_Count = 8;
+
 struct Chunk
 {
     Chunk *east;
@@ -267,8 +450,39 @@ struct Chunk
     s64 vertex_counts[Chunk_Mesh_Count];
     GLuint gl_vbos[Chunk_Mesh_Count];
     GLuint opengl_is_stupid_vaos[Chunk_Mesh_Count];
-    bool is_dirty;
-    bool generated;
+    s64 vbo_capacities[Chunk_Mesh_Count];   // In vertices
+    int mesh_lod;       // Each level halves the resolution of the mesh
+    Vec2f mesh_y_range;  // Vertical extent of the generated meshes, used for the occlusion bounding box
+
+    // Vertices of the meshes are ordered by section, the vertices of section s of a mesh
+    // are in [section_vertex_offsets[type][s], section_vertex_offsets[type][s + 1])
+    u32 section_vertex_offsets[Chunk_Mesh_Count][Chunk_Section_Count + 1];
+
+    // Water faces are drawn through an index buffer sorted back to front,
+    // that is updated when the camera moves to another Chunk_Size^3 cell
+    GLuint gl_water_ebo;
+    Array<Vec3f> water_face_centers;
+    Vec3l water_sort_camera_cell;
+    bool water_sort_valid;
+
+    GLuint gl_occlusion_query;
+    bool occlusion_query_pending;
+    bool occluded;  // Result of the last occlusion query that came back
+
+    bool is_dirty;          // The whole mesh needs to be generated again
+    u32 dirty_sections;     // Bit s is set if the mesh of section s needs to be generated again
+    Chunk_Stage stage;
+
+    // Type of all the blocks of each section, Block_Type_Count if a section has more
+    // than one type. Filled in by the blocks stage
+    Block_Type section_types[Chunk_Section_Count];
+
+    // y + 1 of the highest block of each column for each Heightmap_Type, 0 if there is none.
+    // Computed by the blocks stage and kept up to date by the following edits.
+    u16 heightmaps[Heightmap_Count][Chunk_Size * Chunk_Size];
+
+    // Edits of the features of this chunk for each neighbour, see chunk_neighbour_index
+    Array<Feature_Edit> outgoing_edits[Chunk_Neighbour_Count];
 
     Terrain_Values terrain_values[Chunk_Size * Chunk_Size];
     Block blocks[Chunk_Size * Chunk_Size * Chunk_Height];
@@ -276,33 +490,220 @@ struct Chunk
 
 #define chunk_block_index(x, y, z) ((y) * Chunk_Size * Chunk_Size + (x) * Chunk_Size + (z))
 
+static const int Chunk_Max_Lod = 3;
+
+// Far terrain is a heightmap of the surface level sampled at a coarse resolution, drawn
+// beyond the voxel render distance. Tiles are only generated from 2D terrain values
+static const int Far_Terrain_Tile_Size = 8;         // In chunks
+static const int Far_Terrain_Min_Sample_Step = 8;   // In blocks
+static const int Far_Terrain_Max_Sample_Step = 32;  // In blocks
+static const int Far_Terrain_Max_Distance = 256;    // In chunks
+
+struct Far_Terrain_Vertex
+{
+    Vec3f position;
+    Vec3f normal;
+    u8 block_id;
+};
+
+struct Far_Terrain_Tile
+{
+    s64 x, z;
+    int sample_step;
+
+    s64 vertex_count;
+    GLuint gl_vbo;
+    GLuint opengl_is_stupid_vao;
+};
+
+// The surface spline baked into a table over the T values it depends on, sampled with
+// multilinear interpolation. The table is rebuilt a slice at a time when the spline changes,
+// and generation uses the exact spline until it is ready.
+// The values of each dimension are a uniform grid over [0, 1] with the x of every knot on
+// that dimension added, so the spline has no knot inside a cell and interpolating it does
+// not cut the corners of the sharp knots. Once baked, every cell is compared to the spline,
+// and the cells that are still too far from it, where the spline is too steep for the grid,
+// are evaluated with the exact spline.
+static const s64 Surface_Spline_Lut_Max_Values = 1 << 21;
+static const s64 Surface_Spline_Lut_Bake_Values_Per_Frame = 16384;
+static const int Surface_Spline_Lut_Error_Samples = 4096;
+static const f32 Surface_Spline_Lut_Max_Cell_Error = 0.25f;    // In blocks, at the points checked in each cell
+static const int Surface_Spline_Lut_Max_Resolution = 129;
+static const int Surface_Spline_Lut_Max_Axis_Values = Surface_Spline_Lut_Max_Resolution + Compiled_Hermite_Spline::Max_Knots;
+
+struct Surface_Spline_Lut
+{
+    int dimension_count;
+    int dimensions[4];      // T value index of each dimension of the table
+    int resolution;         // Points of the uniform grid, including both ends of [0, 1]
+    s64 strides[4];
+
+    int axis_counts[4];
+    f32 axis_values[4][Surface_Spline_Lut_Max_Axis_Values];     // Sorted T values of each dimension
+    s16 axis_lookup[4][Surface_Spline_Lut_Max_Resolution];      // Last axis value at or before each point of the uniform grid
+
+    s64 value_count;
+    f32 *values;            // Spline results, in [0, 1] like the spline itself
+    u64 *exact_cells;       // One bit per cell, indexed by the first value of the cell
+    s64 exact_cell_count;
+
+    u64 spline_hash;        // Hash of the compiled spline the table was baked from
+    s64 baked_count;
+    s64 checked_count;      // Cells compared to the spline, after all the values are baked
+    bool ready;
+
+    f32 max_error;          // In blocks, measured against the nested spline once baked
+    f32 average_error;
+};
+
+void surface_spline_lut_bake_all (World *world);
+void world_update_surface_spline_lut (World *world);
+bool surface_spline_lut_sample (const Surface_Spline_Lut *lut, const f32 t_values[4], f32 *result);
+
+// The terrain values are cached by regions of Terrain_Region_Size * Terrain_Region_Size chunks,
+// whose values are all generated in one pass. This amortizes the per call setup of the noise and
+// spline batches, and the coarse sampling modes share the lattice points on the chunk borders.
+// Chunks and the terrain noise maps read their values from the cache, so the columns are only
+// computed once unless their region has been evicted. Sparse samples (far terrain, single
+// columns) use the regions that are already cached, without generating new ones.
+const int Terrain_Region_Size = 8;
+const int Terrain_Region_Width = Terrain_Region_Size * Chunk_Size;
+const int Terrain_Cache_Max_Regions = 128;
+// Units of the chunk generation budget charged for generating a region, one per chunk of the region
+const int Terrain_Region_Generation_Cost = Terrain_Region_Size * Terrain_Region_Size;
+
+struct Terrain_Region
+{
+    s64 x, z;
+    u64 last_used;  // Value of Terrain_Cache.use_counter when the region was last requested
+    Terrain_Values values[Terrain_Region_Width * Terrain_Region_Width];    // values[x * Terrain_Region_Width + z]
+};
+
+struct Terrain_Cache
+{
+    Hash_Map<Vec2i, Terrain_Region *> regions;
+    u64 use_counter;
+    s64 generated_count;
+    s64 hit_count;
+};
+
+// Region files store the chunks of a Terrain_Region. They start with a Region_File_Header,
+// followed for each chunk by a Region_File_Chunk_Header, the heightmaps of the chunk and
+// the blocks of the sections that have more than one type of block, one byte per block.
+// The fields of the headers are written one after the other without padding, in the byte
+// order of the machine.
+const u32 Region_File_Magic = 0x47525446;   // "FTRG"
+const u32 Region_File_Version = 3;
+
+struct Region_File_Header
+{
+    u32 magic;
+    u32 version;
+    s32 region_x, region_z;
+    u32 chunk_count;
+};
+
+struct Region_File_Chunk_Header
+{
+    s32 x, z;
+    u8 stage;                               // Chunk_Stage
+    u8 section_types[Chunk_Section_Count];  // Block_Type
+};
+
 struct World
 {
     s32 seed;
+    u64 random_key; // Key of the counter based random streams, derived from the seed
 
     cubiome::Generator cubiome_gen;
     Terrain_Params terrain_params;
 
-    Vec2f noise_offsets[Perlin_Fractal_Max_Octaves][3];
+    Vec2f noise_offsets[3][Perlin_Fractal_Max_Octaves];
+    Vec3f density_noise_offsets[Perlin_Fractal_Max_Octaves];
+    Perlin_Permutation noise_permutations[3][Perlin_Fractal_Max_Octaves];
+    Perlin_Permutation density_noise_permutations[Perlin_Fractal_Max_Octaves];
+
+    Compiled_Hermite_Spline surface_spline;   // Compiled from terrain_params.surface_spline
+    Surface_Spline_Lut surface_spline_lut;
 
     Chunk *origin_chunk;
     Hash_Map<Vec2i, Chunk *> all_loaded_chunks;
+
+    Hash_Map<Vec2i, Far_Terrain_Tile *> far_terrain_tiles;
+    Terrain_Cache terrain_cache;
 };
 
 extern World g_world;
 
+enum Cubiome_Climate : u8
+{
+    Cubiome_Climate_Continentalness,
+    Cubiome_Climate_Erosion,
+    Cubiome_Climate_Weirdness,
+    Cubiome_Climate_Depth,
+
+    Cubiome_Climate_Count,
+};
+
+// Per-thread state for sampling the cubiomes biome noise. World.cubiome_gen is only read
+// once seeded, so all the samplers share it, and each sampler owns the cache that
+// sampleBiomeNoise writes to.
+// The biome noise is sampled at biome scale (1:4) over a region of chunks, with one more
+// row and column of biome cells on the positive sides so the columns of the last cells
+// can be interpolated. The biome ids are laid out like the output of genBiomes for the
+// same range, and the climate values alongside them.
+struct Cubiome_Sampler
+{
+    const cubiome::Generator *generator;
+    u64 biome_cache;
+
+    cubiome::Range range;   // Range of the biome cells that are currently sampled, sx == 0 if none
+    s64 cell_capacity;
+    int *biomes;            // getMinCacheSize (generator, 4, capacity) ints
+    f32 *climate;           // Cubiome_Climate_Count values per biome cell
+};
+
+void cubiome_sampler_init (Cubiome_Sampler *sampler, World *world);
+void cubiome_sampler_cleanup (Cubiome_Sampler *sampler);
+void cubiome_sample_region (Cubiome_Sampler *sampler, s64 chunk_x, s64 chunk_z, s64 chunk_count_x, s64 chunk_count_z);
+void cubiome_sample_terrain_values (Cubiome_Sampler *sampler, s64 chunk_x, s64 chunk_z, Terrain_Values *values);
+void cubiome_sample_terrain_values_parallel (World *world, s64 chunk_count, const Vec2l *chunk_positions, Terrain_Values *values, int thread_count);
+void cubiome_benchmark (World *world, int chunk_count);
+
 void chunk_init (Chunk *chunk, s64 x, s64 z);
 void chunk_cleanup (Chunk *chunk);
 Vec2i chunk_absolute_to_relative_coordinates (Chunk *chunk, s64 x, s64 z);
 Vec2l chunk_position_from_block_position (s64 x, s64 z);
+u64 chunk_random_key (World *world, s64 chunk_x, s64 chunk_z, u64 salt);
+u64 block_random_key (World *world, s64 x, s64 y, s64 z, u64 salt);
 Chunk *chunk_get_at_relative_coordinates (Chunk *chunk, s64 x, s64 y, s64 z);
 Block chunk_get_block_in_chunk (Chunk *chunk, s64 x, s64 y, s64 z);
 Block chunk_get_block (Chunk *chunk, s64 x, s64 y, s64 z);
 Terrain_Values chunk_get_terrain_values (Chunk *chunk, s64 x, s64 z);
+s64 chunk_get_height (Chunk *chunk, Heightmap_Type type, s64 x, s64 z);
+void chunk_compute_heightmaps (Chunk *chunk);
+void chunk_update_heightmaps_at (Chunk *chunk, s64 x, s64 y, s64 z);
+Chunk_Stage chunk_stage_neighbour_requirement (Chunk_Stage stage);
+bool chunk_neighbours_reached_stage (Chunk *chunk, Chunk_Stage stage);
+bool world_advance_chunk (World *world, Chunk *chunk, Chunk_Stage target, int *budget = null);
 void chunk_generate (World *world, Chunk *chunk);
+int chunk_lod_for_distance (f32 distance_in_chunks);
 void chunk_generate_mesh_data (Chunk *chunk);
+void chunk_generate_section_meshes (Chunk *chunk);
 void chunk_draw (Chunk *chunk, Camera *camera);
 
+void terrain_values_generate (World *world, s64 start_x, s64 start_z, int width, Terrain_Values *values);
+void terrain_cache_init (Terrain_Cache *cache);
+void terrain_cache_clear (Terrain_Cache *cache);
+Terrain_Region *terrain_cache_get_region (World *world, s64 region_x, s64 region_z);
+Terrain_Region *terrain_cache_get_region_of_chunk (World *world, s64 chunk_x, s64 chunk_z);
+Terrain_Region *terrain_cache_find_region (Terrain_Cache *cache, s64 region_x, s64 region_z);
+const Terrain_Values *terrain_cache_find_column (Terrain_Cache *cache, s64 x, s64 z);
+
+bool region_file_write (const char *filename, s64 region_x, s64 region_z, s64 chunk_count, const Chunk *const *chunks);
+bool world_pregenerate (World *world, s64 chunk_radius, int thread_count, const char *directory);
+
+void world_setup (World *world, s32 seed, Terrain_Params terrain_params = {});
 void world_init (World *world, s32 seed, int chunks_to_pre_generate = 0, Terrain_Params terrain_params = {});
 Chunk *world_get_chunk (World *world, s64 x, s64 z);
 Chunk *world_get_chunk_at_block_position (World *world, s64 x, s64 z);
@@ -311,4 +712,31 @@ Chunk *world_generate_chunk (World *world, s64 x, s64 z);
 void world_draw_chunks (World *world, Camera *camera);
 void world_clear_chunks (World *world);
 Block world_get_block (World *world, s64 x, s64 y, s64 z);
+s64 world_get_height (World *world, Heightmap_Type type, s64 x, s64 z);
+
+struct World_Edit_Chunk
+{
+    Chunk *chunk;
+    u32 touched_sections;   // Sections that had blocks changed
+};
+
+// Block edits applied as a batch. Blocks are written as they are added, but the types of the
+// sections they touch are only computed again on commit, once per section. Edits are only
+// allowed in chunks that have reached the light stage.
+struct World_Edit
+{
+    World *world;
+    Array<World_Edit_Chunk> chunks;
+};
+
+void world_edit_begin (World_Edit *edit, World *world, Allocator allocator);
+bool world_edit_set_block (World_Edit *edit, s64 x, s64 y, s64 z, Block_Type type);
+void world_edit_commit (World_Edit *edit);
+bool world_set_block (World *world, s64 x, s64 y, s64 z, Block_Type type);
+bool world_raycast_block (World *world, Vec3f origin, Vec3f direction, f32 max_distance, Vec3l *hit, Vec3l *normal);
+Terrain_Values world_sample_terrain_values (World *world, s64 x, s64 z);
+
+void far_terrain_update (World *world, Camera *camera);
+void far_terrain_draw (World *world, Camera *camera);
+void far_terrain_clear (World *world);
 
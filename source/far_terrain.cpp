@@ -0,0 +1,318 @@
+#include "Minecraft.hpp"
+
+extern GLuint g_far_terrain_shader;
+
+static const f32 Far_Terrain_Skirt_Depth = 32;
+static const f32 Far_Terrain_Near_Plane = 8;
+
+int far_terrain_sample_step_for_distance (f32 distance_in_chunks)
+{
+    if (distance_in_chunks < 32)
+        return Far_Terrain_Min_Sample_Step;
+    if (distance_in_chunks < 96)
+        return Far_Terrain_Min_Sample_Step * 2;
+
+    return Far_Terrain_Max_Sample_Step;
+}
+
+// The radius around the camera that is fully covered by voxel chunks
+f32 far_terrain_inner_radius ()
+{
+    return max ((g_render_distance - 1.5f) * Chunk_Size, 0.0f);
+}
+
+void far_terrain_tile_cleanup (Far_Terrain_Tile *tile)
+{
+    glDeleteVertexArrays (1, &tile->opengl_is_stupid_vao);
+    glDeleteBuffers (1, &tile->gl_vbo);
+}
+
+void far_terrain_clear (World *world)
+{
+    for_hash_map (it, world->far_terrain_tiles)
+    {
+        far_terrain_tile_cleanup (*it.value);
+        mem_free (*it.value, heap_allocator ());
+        hash_map_it_remove (&world->far_terrain_tiles, it);
+    }
+}
+
+void far_terrain_push_quad (Array<Far_Terrain_Vertex> *vertices, const Far_Terrain_Vertex &a, const Far_Terrain_Vertex &b, const Far_Terrain_Vertex &c, const Far_Terrain_Vertex &d)
+{
+    array_push (vertices, a);
+    array_push (vertices, c);
+    array_push (vertices, b);
+    array_push (vertices, a);
+    array_push (vertices, d);
+    array_push (vertices, c);
+}
+
+void far_terrain_tile_generate (World *world, Far_Terrain_Tile *tile, int sample_step)
+{
+    auto state = arena_get_state (&frame_arena);
+    defer (arena_set_state (&frame_arena, state));
+
+    int tile_size_in_blocks = Far_Terrain_Tile_Size * Chunk_Size;
+    int cells = tile_size_in_blocks / sample_step;
+
+    // We sample one more row on each side to calculate normals at the edges
+    int samples = cells + 3;
+    f32 *heights = mem_alloc_uninit (f32, samples * samples, frame_allocator);
+    bool *is_water = mem_alloc_uninit (bool, samples * samples, frame_allocator);
+
+    s64 origin_x = tile->x * tile_size_in_blocks;
+    s64 origin_z = tile->z * tile_size_in_blocks;
+
+    f32 max_amplitude[3];
+    terrain_values_max_amplitude (world, max_amplitude);
+
+    for_range (i, 0, samples)
+    {
+        for_range (j, 0, samples)
+        {
+            s64 x = origin_x + (i - 1) * sample_step;
+            s64 z = origin_z + (j - 1) * sample_step;
+
+            // Samples are too sparse to generate whole regions for, but the cached ones are reused,
+            // which also makes the tiles match the chunks when a coarse sampling mode is used
+            Terrain_Values values;
+            auto cached = terrain_cache_find_column (&world->terrain_cache, x, z);
+            if (cached)
+                values = *cached;
+            else
+                terrain_values_calculate (world, max_amplitude, cast (int) x, cast (int) z, &values);
+
+            // Match the top of the highest block of the column
+            f32 surface = floorf (values.surface_level) + 0.5f;
+            f32 water = world->terrain_params.water_level + 0.5f;
+
+            is_water[i * samples + j] = surface < water;
+            heights[i * samples + j] = max (surface, water);
+        }
+    }
+
+    Array<Far_Terrain_Vertex> grid;
+    array_init (&grid, frame_allocator, (cells + 1) * (cells + 1));
+
+    for_range (i, 1, cells + 2)
+    {
+        for_range (j, 1, cells + 2)
+        {
+            f32 dx = heights[(i + 1) * samples + j] - heights[(i - 1) * samples + j];
+            f32 dz = heights[i * samples + j + 1] - heights[i * samples + j - 1];
+
+            auto v = array_push (&grid);
+            v->position.x = cast (f32) (origin_x + (i - 1) * sample_step) - 0.5f;
+            v->position.y = heights[i * samples + j];
+            v->position.z = cast (f32) (origin_z + (j - 1) * sample_step) - 0.5f;
+            v->normal = normalized (Vec3f{-dx, 2.0f * sample_step, -dz});
+            v->block_id = is_water[i * samples + j] ? Block_Type_Water : Block_Type_Dirt;
+        }
+    }
+
+    Array<Far_Terrain_Vertex> vertices;
+    array_init (&vertices, frame_allocator, cells * cells * 6 + cells * 4 * 6);
+
+    #define grid_vertex(i, j) grid[(i) * (cells + 1) + (j)]
+
+    for_range (i, 0, cells)
+    {
+        for_range (j, 0, cells)
+        {
+            far_terrain_push_quad (&vertices,
+                grid_vertex (i, j), grid_vertex (i + 1, j),
+                grid_vertex (i + 1, j + 1), grid_vertex (i, j + 1));
+        }
+    }
+
+    // Tiles of different resolutions do not line up exactly, so we
+    // add skirts on the edges to hide the cracks between them
+    for_range (k, 0, cells)
+    {
+        Far_Terrain_Vertex edges[4][2] = {
+            {grid_vertex (k, 0),     grid_vertex (k + 1, 0)},
+            {grid_vertex (k, cells), grid_vertex (k + 1, cells)},
+            {grid_vertex (0, k),     grid_vertex (0, k + 1)},
+            {grid_vertex (cells, k), grid_vertex (cells, k + 1)},
+        };
+
+        for_range (e, 0, 4)
+        {
+            auto bottom0 = edges[e][0];
+            auto bottom1 = edges[e][1];
+            bottom0.position.y -= Far_Terrain_Skirt_Depth;
+            bottom1.position.y -= Far_Terrain_Skirt_Depth;
+
+            far_terrain_push_quad (&vertices, edges[e][0], edges[e][1], bottom1, bottom0);
+        }
+    }
+
+    #undef grid_vertex
+
+    tile->sample_step = sample_step;
+    tile->vertex_count = vertices.count;
+
+    glBindVertexArray (tile->opengl_is_stupid_vao);
+    glBindBuffer (GL_ARRAY_BUFFER, tile->gl_vbo);
+
+    glBufferData (GL_ARRAY_BUFFER, sizeof (Far_Terrain_Vertex) * vertices.count, vertices.data, GL_STATIC_DRAW);
+
+    glBindVertexArray (0);
+    glBindBuffer (GL_ARRAY_BUFFER, 0);
+}
+
+Far_Terrain_Tile *far_terrain_create_tile (World *world, s64 x, s64 z)
+{
+    auto tile = mem_alloc_typed (Far_Terrain_Tile, 1, heap_allocator ());
+    tile->x = x;
+    tile->z = z;
+
+    glGenVertexArrays (1, &tile->opengl_is_stupid_vao);
+    glGenBuffers (1, &tile->gl_vbo);
+
+    glBindVertexArray (tile->opengl_is_stupid_vao);
+    glBindBuffer (GL_ARRAY_BUFFER, tile->gl_vbo);
+
+    glEnableVertexAttribArray (0);
+    glVertexAttribPointer (0, 3, GL_FLOAT, GL_FALSE, sizeof (Far_Terrain_Vertex), cast (void *) offsetof (Far_Terrain_Vertex, position));
+
+    glEnableVertexAttribArray (1);
+    glVertexAttribPointer (1, 3, GL_FLOAT, GL_FALSE, sizeof (Far_Terrain_Vertex), cast (void *) offsetof (Far_Terrain_Vertex, normal));
+
+    glEnableVertexAttribArray (2);
+    glVertexAttribIPointer (2, 1, GL_UNSIGNED_BYTE, sizeof (Far_Terrain_Vertex), cast (void *) offsetof (Far_Terrain_Vertex, block_id));
+
+    glBindVertexArray (0);
+    glBindBuffer (GL_ARRAY_BUFFER, 0);
+
+    hash_map_insert (&world->far_terrain_tiles, {cast (s32) x, cast (s32) z}, tile);
+
+    return tile;
+}
+
+void far_terrain_tile_distances (Camera *camera, s64 x, s64 z, f32 *closest, f32 *farthest)
+{
+    f32 tile_size = cast (f32) Far_Terrain_Tile_Size * Chunk_Size;
+    Vec2f box_min = {x * tile_size, z * tile_size};
+    Vec2f box_max = {box_min.x + tile_size, box_min.y + tile_size};
+    Vec2f p = {camera->position.x, camera->position.z};
+
+    Vec2f closest_point = {clamp (p.x, box_min.x, box_max.x), clamp (p.y, box_min.y, box_max.y)};
+    Vec2f farthest_point = {
+        p.x - box_min.x > box_max.x - p.x ? box_min.x : box_max.x,
+        p.y - box_min.y > box_max.y - p.y ? box_min.y : box_max.y,
+    };
+
+    *closest = distance (closest_point, p);
+    *farthest = distance (farthest_point, p);
+}
+
+void far_terrain_update (World *world, Camera *camera)
+{
+    f32 outer_radius = cast (f32) g_far_terrain_distance * Chunk_Size;
+    f32 inner_radius = far_terrain_inner_radius ();
+
+    // Unload tiles that went out of range
+    for_hash_map (it, world->far_terrain_tiles)
+    {
+        auto tile = *it.value;
+
+        f32 closest, farthest;
+        far_terrain_tile_distances (camera, tile->x, tile->z, &closest, &farthest);
+        if (closest > outer_radius || farthest < inner_radius)
+        {
+            far_terrain_tile_cleanup (tile);
+            mem_free (tile, heap_allocator ());
+            hash_map_it_remove (&world->far_terrain_tiles, it);
+        }
+    }
+
+    f32 tile_size = cast (f32) Far_Terrain_Tile_Size * Chunk_Size;
+    s64 camera_tile_x = cast (s64) floorf (camera->position.x / tile_size);
+    s64 camera_tile_z = cast (s64) floorf (camera->position.z / tile_size);
+    s64 radius = g_far_terrain_distance / Far_Terrain_Tile_Size + 1;
+
+    // Walk the rings of tiles around the camera so the closest tiles get generated first
+    int budget = max (g_far_terrain_tiles_per_frame, 1);
+    for (s64 ring = 0; ring <= radius && budget > 0; ring += 1)
+    {
+        for (s64 i = -ring; i <= ring && budget > 0; i += 1)
+        {
+            s64 step = (i == -ring || i == ring) ? 1 : ring * 2;
+            for (s64 j = -ring; j <= ring && budget > 0; j += step)
+            {
+                s64 x = camera_tile_x + i;
+                s64 z = camera_tile_z + j;
+
+                f32 closest, farthest;
+                far_terrain_tile_distances (camera, x, z, &closest, &farthest);
+                if (closest > outer_radius || farthest < inner_radius)
+                    continue;
+
+                f32 center_distance = (closest + farthest) * 0.5f / Chunk_Size;
+                int sample_step = far_terrain_sample_step_for_distance (center_distance);
+
+                Far_Terrain_Tile *tile;
+                auto tile_ptr = hash_map_get (&world->far_terrain_tiles, {cast (s32) x, cast (s32) z});
+                if (tile_ptr)
+                    tile = *tile_ptr;
+                else
+                    tile = far_terrain_create_tile (world, x, z);
+
+                if (tile->sample_step == sample_step)
+                    continue;
+
+                far_terrain_tile_generate (world, tile, sample_step);
+                budget -= 1;
+                g_frame_far_terrain_tile_count += 1;
+            }
+        }
+    }
+}
+
+void far_terrain_draw (World *world, Camera *camera)
+{
+    // The far terrain gets its own depth range so we keep a decent depth precision at
+    // large distances. The depth buffer is cleared afterwards for the chunk meshes.
+    f32 far_plane = cast (f32) g_far_terrain_distance * Chunk_Size * 2;
+    auto projection = mat4_perspective_projection<f32> (camera->fov, camera->aspect_ratio, Far_Terrain_Near_Plane, far_plane);
+    auto view_projection = projection * camera->view_matrix;
+
+    glDisable (GL_BLEND);
+    glDisable (GL_CULL_FACE);
+
+    glActiveTexture (0);
+    glBindTexture (GL_TEXTURE_2D, g_texture_atlas);
+
+    glUseProgram (g_far_terrain_shader);
+
+    auto loc = glGetUniformLocation (g_far_terrain_shader, "u_View_Projection_Matrix");
+    glUniformMatrix4fv (loc, 1, GL_TRUE, view_projection.comps);
+
+    loc = glGetUniformLocation (g_far_terrain_shader, "u_Texture_Atlas");
+    glUniform1i (loc, 0);
+
+    loc = glGetUniformLocation (g_far_terrain_shader, "u_Camera_Position");
+    glUniform3f (loc, camera->position.x, camera->position.y, camera->position.z);
+
+    loc = glGetUniformLocation (g_far_terrain_shader, "u_Inner_Radius");
+    glUniform1f (loc, far_terrain_inner_radius ());
+
+    loc = glGetUniformLocation (g_far_terrain_shader, "u_Fog_Distance");
+    glUniform1f (loc, cast (f32) g_far_terrain_distance * Chunk_Size);
+
+    for_hash_map (it, world->far_terrain_tiles)
+    {
+        auto tile = *it.value;
+        if (tile->vertex_count == 0)
+            continue;
+
+        glBindVertexArray (tile->opengl_is_stupid_vao);
+        glDrawArrays (GL_TRIANGLES, 0, tile->vertex_count);
+    }
+
+    glBindVertexArray (0);
+
+    glEnable (GL_CULL_FACE);
+    glClear (GL_DEPTH_BUFFER_BIT);
+}
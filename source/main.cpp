@@ -1,7 +1,7 @@
 #include "Minecraft.hpp"
 
-Arena     frame_arena;
-Allocator frame_allocator;
+thread_local Arena     frame_arena;
+thread_local Allocator frame_allocator;
 
 Vec2f g_prev_mouse_pos;
 Vec2f g_curr_mouse_pos;
@@ -17,10 +17,34 @@ s64 g_chunk_generation_samples = 0;
 s64 g_chunk_creation_time = 0;
 s64 g_chunk_creation_samples = 0;
 s64 g_drawn_vertex_count = 0;
+s64 g_occluded_chunk_count = 0;
 s64 g_delta_time = 0;
+s64 g_frame_work_time = 0;
+s64 g_frame_generation_time = 0;
+s64 g_frame_meshing_time = 0;
+s64 g_frame_draw_time = 0;
+int g_frame_generated_chunk_count = 0;
+int g_frame_meshed_chunk_count = 0;
+int g_frame_far_terrain_tile_count = 0;
+s64 g_chunk_meshing_time = 0;
+s64 g_chunk_meshing_samples = 0;
+s64 g_section_meshing_time = 0;
+s64 g_section_meshing_samples = 0;
 
 bool g_generate_new_chunks = true;
 int g_render_distance = 4;
+bool g_occlusion_culling = false;
+int g_lod_distance = 8;
+bool g_far_terrain_enabled = false;
+int g_far_terrain_distance = 64;
+
+bool g_adaptive_render_distance = false;
+s64 g_target_frame_time = 16667;
+int g_min_render_distance = 2;
+int g_max_render_distance = 32;
+int g_chunk_generation_budget = 0;
+int g_chunk_meshing_budget = 0;
+int g_far_terrain_tiles_per_frame = Default_Far_Terrain_Tiles_Per_Frame;
 
 bool g_show_ui = true;
 
@@ -62,6 +86,537 @@ f32 hermite_cubic_calculate (const Nested_Hermite_Spline *spline, const Slice<f3
     );
 }
 
+static const f32 Frame_Time_Smoothing = 0.05;
+static const f32 Frame_Time_Shrink_Threshold = 1.1;   // Relative to the target frame time
+static const f32 Frame_Time_Grow_Threshold = 0.75;
+static const int Render_Distance_Change_Cooldown = 60;  // In frames
+static const int Max_Streaming_Budget = 64;
+
+// Grows or shrinks the render distance and the streaming budgets so that the time spent
+// working on a frame stays below g_target_frame_time. The work time is used rather than
+// g_delta_time because the latter includes waiting for vsync.
+void update_adaptive_render_distance (int pending_chunk_count)
+{
+    static f32 smoothed_work_time = 0;
+    static f32 smoothed_streaming_time = 0;
+    static f32 smoothed_draw_time = 0;
+    static int cooldown = 0;
+
+    if (!g_adaptive_render_distance)
+    {
+        g_chunk_generation_budget = 0;
+        g_chunk_meshing_budget = 0;
+        g_far_terrain_tiles_per_frame = Default_Far_Terrain_Tiles_Per_Frame;
+        smoothed_work_time = 0;
+        smoothed_streaming_time = 0;
+        smoothed_draw_time = 0;
+        cooldown = 0;
+
+        return;
+    }
+
+    f32 streaming_time = cast (f32) (g_frame_generation_time + g_frame_meshing_time);
+    if (smoothed_work_time == 0)
+    {
+        smoothed_work_time = cast (f32) g_frame_work_time;
+        smoothed_streaming_time = streaming_time;
+        smoothed_draw_time = cast (f32) g_frame_draw_time;
+    }
+    else
+    {
+        smoothed_work_time = lerp (smoothed_work_time, cast (f32) g_frame_work_time, Frame_Time_Smoothing);
+        smoothed_streaming_time = lerp (smoothed_streaming_time, streaming_time, Frame_Time_Smoothing);
+        smoothed_draw_time = lerp (smoothed_draw_time, cast (f32) g_frame_draw_time, Frame_Time_Smoothing);
+    }
+
+    f32 target = cast (f32) g_target_frame_time;
+
+    // Whatever is left of the frame once drawing and everything else is done is given to
+    // streaming, split between chunk generation and meshing
+    f32 other_time = max (smoothed_work_time - smoothed_streaming_time - smoothed_draw_time, 0.0f);
+    f32 headroom = max (target * Frame_Time_Shrink_Threshold * 0.9f - other_time - smoothed_draw_time, 0.0f);
+
+    f32 generation_cost = g_chunk_generation_samples > 0 ? g_chunk_generation_time / cast (f32) g_chunk_generation_samples : 1000.0f;
+    f32 meshing_cost = g_chunk_meshing_samples > 0 ? g_chunk_meshing_time / cast (f32) g_chunk_meshing_samples : 1000.0f;
+    generation_cost = max (generation_cost, 1.0f);
+    meshing_cost = max (meshing_cost, 1.0f);
+
+    g_chunk_generation_budget = clamp (cast (int) (headroom * 0.5f / generation_cost), 1, Max_Streaming_Budget);
+    g_chunk_meshing_budget = clamp (cast (int) (headroom * 0.5f / meshing_cost), 1, Max_Streaming_Budget);
+    g_far_terrain_tiles_per_frame = clamp (g_chunk_generation_budget / 4, 1, 8);
+
+    if (cooldown > 0)
+    {
+        cooldown -= 1;
+        return;
+    }
+
+    if (smoothed_work_time > target * Frame_Time_Shrink_Threshold && g_render_distance > g_min_render_distance)
+    {
+        g_render_distance -= 1;
+        cooldown = Render_Distance_Change_Cooldown;
+    }
+    else if (pending_chunk_count == 0 && g_render_distance < g_max_render_distance)
+    {
+        // Drawing grows with the area of the render distance, so predict what the work time
+        // would be one chunk further. Only grow once everything at the current distance has
+        // been streamed in, otherwise we would be measuring a world that is not fully loaded yet
+        f32 growth = (g_render_distance + 1) / cast (f32) g_render_distance;
+        f32 predicted_work_time = smoothed_work_time + smoothed_draw_time * (growth * growth - 1);
+        if (predicted_work_time < target * Frame_Time_Grow_Threshold)
+        {
+            g_render_distance += 1;
+            cooldown = Render_Distance_Change_Cooldown;
+        }
+    }
+}
+
+static int hermite_spline_compile_recursive (const Nested_Hermite_Spline *spline, Compiled_Hermite_Spline *compiled)
+{
+    if (compiled->spline_count >= Compiled_Hermite_Spline::Max_Splines
+    || compiled->knot_count + spline->knots.count > Compiled_Hermite_Spline::Max_Knots)
+        return -1;
+
+    int index = compiled->spline_count;
+    compiled->spline_count += 1;
+
+    int first_knot = compiled->knot_count;
+    compiled->knot_count += cast (int) spline->knots.count;
+
+    compiled->t_value_indices[index] = spline->t_value_index;
+    compiled->first_knots[index] = first_knot;
+    compiled->knot_counts[index] = cast (s32) spline->knots.count;
+
+    for_range (i, 0, spline->knots.count)
+    {
+        const auto &knot = spline->knots[i];
+
+        compiled->knot_x[first_knot + i] = knot.x;
+        compiled->knot_y[first_knot + i] = knot.y;
+        compiled->knot_derivatives[first_knot + i] = knot.derivative;
+        compiled->knot_children[first_knot + i] = -1;
+
+        if (knot.is_nested_spline)
+        {
+            int child = hermite_spline_compile_recursive (knot.spline, compiled);
+            if (child < 0)
+                return -1;
+
+            compiled->knot_children[first_knot + i] = child;
+        }
+    }
+
+    return index;
+}
+
+bool hermite_spline_compile (const Nested_Hermite_Spline *root, Compiled_Hermite_Spline *compiled)
+{
+    compiled->spline_count = 0;
+    compiled->knot_count = 0;
+
+    if (!root)
+        return false;
+
+    if (hermite_spline_compile_recursive (root, compiled) < 0)
+    {
+        compiled->spline_count = 0;
+        compiled->knot_count = 0;
+
+        return false;
+    }
+
+    return true;
+}
+
+inline
+static f32 hermite_compiled_knot_value (const Compiled_Hermite_Spline *spline, const f32 *t_values, int knot)
+{
+    if (spline->knot_children[knot] >= 0)
+        return hermite_spline_evaluate (spline, t_values, spline->knot_children[knot]);
+
+    return spline->knot_y[knot];
+}
+
+// Same as hermite_cubic_calculate for Nested_Hermite_Spline, so results are identical
+f32 hermite_spline_evaluate (const Compiled_Hermite_Spline *spline, const f32 *t_values, int spline_index)
+{
+    if (spline->spline_count == 0)
+        return 0;
+
+    int count = spline->knot_counts[spline_index];
+    if (count == 0)
+        return 0;
+
+    f32 t = t_values[spline->t_value_indices[spline_index]];
+    int first = spline->first_knots[spline_index];
+    const f32 *xs = spline->knot_x + first;
+
+    // Find the first knot with x >= t. With at most Nested_Hermite_Spline::Max_Knots knots, a
+    // linear scan beats a branchless binary search since t is coherent across neighbouring
+    // columns and the exit is well predicted
+    int index;
+    for (index = 0; index < count; index += 1)
+    {
+        if (xs[index] >= t)
+            break;
+    }
+
+    // Special case if t is outside of the range of the spline
+    if (index == 0 || index == count)
+    {
+        if (index != 0)
+            index -= 1;
+
+        int knot = first + index;
+        f32 y = hermite_compiled_knot_value (spline, t_values, knot);
+
+        // Linearly extend the spline
+        return y + spline->knot_derivatives[knot] * (t - spline->knot_x[knot]);
+    }
+
+    int k0 = first + index - 1;
+    int k1 = first + index;
+
+    return hermite_cubic_calculate (
+        spline->knot_x[k0], hermite_compiled_knot_value (spline, t_values, k0), spline->knot_derivatives[k0],
+        spline->knot_x[k1], hermite_compiled_knot_value (spline, t_values, k1), spline->knot_derivatives[k1],
+        inverse_lerp (spline->knot_x[k0], spline->knot_x[k1], t)
+    );
+}
+
+// Batched evaluation
+// All the lanes are evaluated one spline at a time: the knot interval of each lane is found,
+// then the nested splines are evaluated once for the group of lanes that need each of them,
+// and finally the Hermite math is done for all lanes at once, 4 lanes at a time with SSE.
+
+#if defined (_M_X64) || defined (__x86_64__)
+#define HERMITE_SIMD 1
+#include <emmintrin.h>
+#endif
+
+// Same math as hermite_cubic_calculate for lanes that all are in the same knot interval,
+// with t being the value of the T value and not the position in the interval. Edge lanes
+// are linearly extended from (x0, y0, der0) instead.
+static void hermite_cubic_calculate_lanes (s64 count, bool is_edge,
+    f32 x0, const f32 *y0, f32 der0,
+    f32 x1, const f32 *y1, f32 der1,
+    const f32 *t, f32 *results)
+{
+    s64 i = 0;
+
+    if (is_edge)
+    {
+        for (; i < count; i += 1)
+            results[i] = y0[i] + der0 * (t[i] - x0);
+
+        return;
+    }
+
+#ifdef HERMITE_SIMD
+    __m128 one = _mm_set1_ps (1);
+    __m128 x0s = _mm_set1_ps (x0);
+    __m128 dx = _mm_set1_ps (x1 - x0);
+    __m128 d0_dx = _mm_set1_ps (der0 * (x1 - x0));
+    __m128 neg_d1_dx = _mm_set1_ps (-der1 * (x1 - x0));
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 y0s = _mm_loadu_ps (y0 + i);
+        __m128 y1s = _mm_loadu_ps (y1 + i);
+        __m128 ts  = _mm_loadu_ps (t + i);
+
+        // inverse_lerp (x0, x1, t)
+        __m128 u = _mm_div_ps (_mm_sub_ps (ts, x0s), dx);
+
+        __m128 dy = _mm_sub_ps (y1s, y0s);
+        __m128 f8 = _mm_sub_ps (d0_dx, dy);
+        __m128 f9 = _mm_add_ps (neg_d1_dx, dy);
+
+        __m128 y = _mm_add_ps (y0s, _mm_mul_ps (u, dy));
+        __m128 f = _mm_add_ps (f8, _mm_mul_ps (u, _mm_sub_ps (f9, f8)));
+
+        _mm_storeu_ps (results + i, _mm_add_ps (y, _mm_mul_ps (_mm_mul_ps (u, _mm_sub_ps (one, u)), f)));
+    }
+#endif
+
+    for (; i < count; i += 1)
+        results[i] = hermite_cubic_calculate (x0, y0[i], der0, x1, y1[i], der1, inverse_lerp (x0, x1, t[i]));
+}
+
+// results[i] is the value for the sample lanes[i]
+static void hermite_spline_evaluate_batch_recursive (const Compiled_Hermite_Spline *spline, int spline_index,
+    const f32 *const *t_values, const s32 *lanes, s64 lane_count, f32 *results)
+{
+    int count = spline->knot_counts[spline_index];
+    if (count == 0)
+    {
+        for_range (i, 0, lane_count)
+            results[i] = 0;
+
+        return;
+    }
+
+    const f32 *ts = t_values[spline->t_value_indices[spline_index]];
+    int first = spline->first_knots[spline_index];
+    const f32 *xs = spline->knot_x + first;
+
+    // The slot of a lane is the index of the first knot with x >= t. Slot s uses knots s - 1 and s,
+    // slots 0 and count are at the edges and only use knots 0 and count - 1 respectively.
+    // Lanes are grouped by slot so the lanes that use knot k are the contiguous slots k and k + 1.
+    int slot_count = count + 1;
+    auto slots = mem_alloc_uninit (s32, lane_count, frame_allocator);
+    auto slot_starts = mem_alloc_typed (s32, slot_count + 1, frame_allocator);
+
+    for_range (i, 0, lane_count)
+    {
+        f32 t = ts[lanes[i]];
+
+        int index;
+        for (index = 0; index < count; index += 1)
+        {
+            if (xs[index] >= t)
+                break;
+        }
+
+        slots[i] = index;
+        slot_starts[index + 1] += 1;
+    }
+
+    for_range (s, 0, slot_count)
+        slot_starts[s + 1] += slot_starts[s];
+
+    auto order = mem_alloc_uninit (s32, lane_count, frame_allocator);
+    auto sorted_lanes = mem_alloc_uninit (s32, lane_count, frame_allocator);
+    auto t = mem_alloc_uninit (f32, lane_count, frame_allocator);
+    {
+        auto cursors = mem_alloc_uninit (s32, slot_count, frame_allocator);
+        memcpy (cursors, slot_starts, sizeof (s32) * slot_count);
+
+        for_range (i, 0, lane_count)
+        {
+            s32 p = cursors[slots[i]];
+            cursors[slots[i]] += 1;
+
+            order[p] = cast (s32) i;
+            sorted_lanes[p] = lanes[i];
+            t[p] = ts[lanes[i]];
+        }
+    }
+
+    // Values of the first and second knot of each lane
+    auto y0 = mem_alloc_uninit (f32, lane_count, frame_allocator);
+    auto y1 = mem_alloc_uninit (f32, lane_count, frame_allocator);
+
+    for_range (k, 0, count)
+    {
+        s32 start = slot_starts[k];
+        s32 middle = slot_starts[k + 1];
+        s32 end = slot_starts[k + 2];
+        if (start == end)
+            continue;
+
+        // Knot k is the second knot of slot k, and the first knot of slot k + 1.
+        // Edge slots use the same knot for both.
+        int child = spline->knot_children[first + k];
+        if (child >= 0)
+        {
+            // Evaluate the nested spline once for all the lanes that use it
+            hermite_spline_evaluate_batch_recursive (spline, child, t_values, sorted_lanes + start, end - start, y1 + start);
+            memcpy (y0 + middle, y1 + middle, sizeof (f32) * (end - middle));
+        }
+        else
+        {
+            f32 y = spline->knot_y[first + k];
+            for_range (p, start, end)
+                y1[p] = y;
+            for_range (p, middle, end)
+                y0[p] = y;
+        }
+    }
+
+    // The first slot only uses knot 0, and the last slot only uses knot count - 1
+    memcpy (y0 + slot_starts[0], y1 + slot_starts[0], sizeof (f32) * (slot_starts[1] - slot_starts[0]));
+    memcpy (y1 + slot_starts[count], y0 + slot_starts[count], sizeof (f32) * (slot_starts[count + 1] - slot_starts[count]));
+
+    auto sorted_results = mem_alloc_uninit (f32, lane_count, frame_allocator);
+    for_range (s, 0, slot_count)
+    {
+        s32 start = slot_starts[s];
+        s32 end = slot_starts[s + 1];
+        if (start == end)
+            continue;
+
+        bool is_edge = s == 0 || s == count;
+        int k0 = first + (s == 0 ? 0 : s - 1);
+        int k1 = first + (s == count ? count - 1 : s);
+
+        hermite_cubic_calculate_lanes (end - start, is_edge,
+            spline->knot_x[k0], y0 + start, spline->knot_derivatives[k0],
+            spline->knot_x[k1], y1 + start, spline->knot_derivatives[k1],
+            t + start, sorted_results + start);
+    }
+
+    for_range (p, 0, lane_count)
+        results[order[p]] = sorted_results[p];
+}
+
+// t_values is an array of pointers to the samples of each T value, so that the samples of T value i
+// are t_values[i][0..count-1]. Gives the same results as hermite_spline_evaluate.
+void hermite_spline_evaluate_batch (const Compiled_Hermite_Spline *spline, const f32 *const *t_values, s64 count, f32 *results)
+{
+    if (spline->spline_count == 0)
+    {
+        for_range (i, 0, count)
+            results[i] = 0;
+
+        return;
+    }
+
+    auto state = arena_get_state (&frame_arena);
+    defer (arena_set_state (&frame_arena, state));
+
+    auto lanes = mem_alloc_uninit (s32, count, frame_allocator);
+    for_range (i, 0, count)
+        lanes[i] = cast (s32) i;
+
+    hermite_spline_evaluate_batch_recursive (spline, 0, t_values, lanes, count, results);
+}
+
+// Compares the evaluation of the default spline by the nested, compiled and batched
+// evaluators, with T values sampled from the terrain noise of the world. The results
+// are printed to the console.
+void hermite_spline_benchmark (World *world, int chunk_count)
+{
+    static Terrain_Params params;
+    static Compiled_Hermite_Spline compiled;
+
+    array_clear (&params.spline_stack);
+    init_default_spline (&params);
+    if (!hermite_spline_compile (params.surface_spline, &compiled))
+    {
+        println ("Could not compile the default spline");
+        return;
+    }
+
+    f32 max_amplitude[3];
+    terrain_values_max_amplitude (world, max_amplitude);
+
+    const int Samples_Per_Chunk = Chunk_Size * Chunk_Size;
+    s64 sample_count = cast (s64) chunk_count * Samples_Per_Chunk;
+
+    f32 *t_values[4];
+    for_range (i, 0, 4)
+        t_values[i] = mem_alloc_uninit (f32, sample_count, heap_allocator ());
+    f32 *results = mem_alloc_uninit (f32, sample_count, heap_allocator ());
+
+    for_range (c, 0, chunk_count)
+    {
+        for_range (x, 0, Chunk_Size)
+        {
+            for_range (z, 0, Chunk_Size)
+            {
+                auto values = world_sample_terrain_values (world, c * Chunk_Size + x, z);
+
+                s64 index = c * Samples_Per_Chunk + x * Chunk_Size + z;
+                for_range (i, 0, 4)
+                    t_values[i][index] = values.noise[i];
+            }
+        }
+    }
+
+    f32 sample[4];
+    f64 nested_sum = 0;
+    s64 start = time_current_monotonic ();
+    for_range (s, 0, sample_count)
+    {
+        for_range (i, 0, 4)
+            sample[i] = t_values[i][s];
+
+        nested_sum += hermite_cubic_calculate (params.surface_spline, slice_make (4, sample));
+    }
+    s64 nested_time = time_current_monotonic () - start;
+
+    f64 compiled_sum = 0;
+    start = time_current_monotonic ();
+    for_range (s, 0, sample_count)
+    {
+        for_range (i, 0, 4)
+            sample[i] = t_values[i][s];
+
+        compiled_sum += hermite_spline_evaluate (&compiled, sample);
+    }
+    s64 compiled_time = time_current_monotonic () - start;
+
+    start = time_current_monotonic ();
+    for_range (c, 0, chunk_count)
+    {
+        const f32 *chunk_t_values[4];
+        for_range (i, 0, 4)
+            chunk_t_values[i] = t_values[i] + c * Samples_Per_Chunk;
+
+        hermite_spline_evaluate_batch (&compiled, chunk_t_values, Samples_Per_Chunk, results + c * Samples_Per_Chunk);
+    }
+    s64 batch_time = time_current_monotonic () - start;
+
+    s64 mismatch_count = 0;
+    for_range (s, 0, sample_count)
+    {
+        for_range (i, 0, 4)
+            sample[i] = t_values[i][s];
+
+        if (results[s] != hermite_cubic_calculate (params.surface_spline, slice_make (4, sample)))
+            mismatch_count += 1;
+    }
+
+    println ("Spline benchmark, %d chunks, %d splines, %d knots (sums %f %f)", chunk_count, compiled.spline_count, compiled.knot_count, nested_sum, compiled_sum);
+    println ("  Nested   %.3f us/chunk", nested_time / cast (f64) chunk_count);
+    println ("  Compiled %.3f us/chunk (x%.2f)", compiled_time / cast (f64) chunk_count, nested_time / cast (f64) max (compiled_time, cast (s64) 1));
+    println ("  Batched  %.3f us/chunk (x%.2f), %lld mismatching samples", batch_time / cast (f64) chunk_count, nested_time / cast (f64) max (batch_time, cast (s64) 1), mismatch_count);
+
+    for_range (i, 0, 4)
+        mem_free (t_values[i], heap_allocator ());
+    mem_free (results, heap_allocator ());
+}
+
+bool parse_s64_argument (const char *str, s64 *result)
+{
+    char *end = null;
+    *result = cast (s64) strtoll (str, &end, 10);
+
+    return end != str && *end == 0;
+}
+
+// Headless mode, started with: pregen <seed> <chunk radius> [thread count] [directory]
+// Generates the chunks around the origin on all the processors by default and writes them
+// to region files, without creating a window
+int pregen_main (int argc, const char **args)
+{
+    if (argc < 2)
+    {
+        println ("Usage: pregen <seed> <chunk radius> [thread count] [directory]");
+        return 1;
+    }
+
+    s64 seed, radius;
+    s64 thread_count = get_processor_count ();
+    if (!parse_s64_argument (args[0], &seed) || !parse_s64_argument (args[1], &radius)
+     || (argc > 2 && !parse_s64_argument (args[2], &thread_count)))
+    {
+        println ("Invalid arguments, expected integers for the seed, the radius and the thread count");
+        return 1;
+    }
+
+    const char *directory = argc > 3 ? args[3] : "pregen";
+
+    // There is no GL context, the world must not create any chunk
+    world_setup (&g_world, cast (s32) seed);
+    defer (terrain_cache_clear (&g_world.terrain_cache));
+
+    if (!world_pregenerate (&g_world, radius, cast (int) thread_count, directory))
+        return 1;
+
+    return 0;
+}
+
 void glfw_error_callback (int error, const char *description)
 {
     println ("GLFW Error (%d): %s", error, description);
@@ -79,6 +634,26 @@ void glfw_key_callback (GLFWwindow *window, int key, int scancode, int action, i
     }
 }
 
+// Left click breaks the block under the crosshair, right click places a stone block against
+// the face that is looked at
+void glfw_mouse_button_callback (GLFWwindow *window, int button, int action, int mods)
+{
+    if (g_show_ui || action != GLFW_PRESS)
+        return;
+    if (button != GLFW_MOUSE_BUTTON_LEFT && button != GLFW_MOUSE_BUTTON_RIGHT)
+        return;
+
+    // The camera looks along the z axis of its transform
+    Vec3l hit, normal;
+    if (!world_raycast_block (&g_world, g_camera.position, up_vector (g_camera.transform), Block_Edit_Reach, &hit, &normal))
+        return;
+
+    if (button == GLFW_MOUSE_BUTTON_LEFT)
+        world_set_block (&g_world, hit.x, hit.y, hit.z, Block_Type_Air);
+    else if (normal != Vec3l{}) // The camera is inside the block otherwise
+        world_set_block (&g_world, hit.x + normal.x, hit.y + normal.y, hit.z + normal.z, Block_Type_Stone);
+}
+
 void update_flying_camera (Camera *camera)
 {
     Vec2f mouse_delta = {};
@@ -119,9 +694,9 @@ void update_camera_matrices (Camera *camera)
 
     int viewport_w, viewport_h;
     glfwGetFramebufferSize (g_window, &viewport_w, &viewport_h);
-    f32 aspect_ratio = viewport_w / cast (f32) viewport_h;
+    camera->aspect_ratio = viewport_w / cast (f32) viewport_h;
 
-    camera->projection_matrix = mat4_perspective_projection<f32> (camera->fov, aspect_ratio, 0.01, 1000.0);
+    camera->projection_matrix = mat4_perspective_projection<f32> (camera->fov, camera->aspect_ratio, Camera_Near_Plane, 1000.0);
     camera->view_projection_matrix = camera->projection_matrix * camera->view_matrix;
 }
 
@@ -135,6 +710,9 @@ int main (int argc, const char **args)
 
     frame_allocator = arena_allocator (&frame_arena);
 
+    if (argc > 1 && strcmp (args[1], "pregen") == 0)
+        return pregen_main (argc - 2, args + 2);
+
     glfwSetErrorCallback (glfw_error_callback);
 
     if (!glfwInit ())
@@ -160,6 +738,7 @@ int main (int argc, const char **args)
     glfwSwapInterval(1);
 
     glfwSetKeyCallback (g_window, glfw_key_callback);
+    glfwSetMouseButtonCallback (g_window, glfw_mouse_button_callback);
 
     if (g_show_ui)
         glfwSetInputMode (g_window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
@@ -231,6 +810,9 @@ int main (int argc, const char **args)
 
     world_init (&g_world, cast (s32) time_current_monotonic ());
 
+    // Generation budget overspent by the previous frames, see world_advance_chunk
+    int generation_debt = 0;
+
     while (!glfwWindowShouldClose (g_window))
     {
         s64 frame_start = time_current_monotonic ();
@@ -249,40 +831,91 @@ int main (int argc, const char **args)
             update_flying_camera (&g_camera);
         update_camera_matrices (&g_camera);
 
+        g_frame_generation_time = 0;
+        g_frame_generated_chunk_count = 0;
+        g_frame_far_terrain_tile_count = 0;
+        int pending_chunk_count = 0;
+
         if (g_generate_new_chunks)
         {
             s64 camera_chunk_x = chunk_position_from_block_position (cast (s64) g_camera.position.x, cast (s64) g_camera.position.z).x;
             s64 camera_chunk_z = chunk_position_from_block_position (cast (s64) g_camera.position.x, cast (s64) g_camera.position.z).y;
 
-            for_range (x, camera_chunk_x - g_render_distance, camera_chunk_x + g_render_distance)
+            // Walk the rings of chunks around the camera so the closest chunks get generated
+            // first when the generation budget does not allow for everything in one frame.
+            // Chunks in range are advanced up to meshing, which advances their neighbours as
+            // far as needed
+            int budget = INT_MAX;
+            if (g_chunk_generation_budget > 0)
+                budget = g_chunk_generation_budget - generation_debt;
+            else
+                generation_debt = 0;
+
+            s64 generated_regions_before = g_world.terrain_cache.generated_count;
+            for (s64 ring = 0; ring <= g_render_distance; ring += 1)
             {
-                for_range (z, camera_chunk_z - g_render_distance, camera_chunk_z + g_render_distance)
+                for (s64 i = -ring; i <= ring; i += 1)
                 {
-                    Vec2f planar_camera_pos = Vec2f{g_camera.position.x, g_camera.position.z};
-                    Vec2f chunk_pos = Vec2f{cast (f32) x * Chunk_Size, cast (f32) z * Chunk_Size};
-
-                    if (distance (planar_camera_pos, chunk_pos) < g_render_distance * Chunk_Size)
+                    s64 step = (i == -ring || i == ring) ? 1 : ring * 2;
+                    for (s64 j = -ring; j <= ring; j += step)
                     {
-                        s64 time_start = time_current_monotonic ();
+                        s64 x = camera_chunk_x + i;
+                        s64 z = camera_chunk_z + j;
+
+                        Vec2f planar_camera_pos = Vec2f{g_camera.position.x, g_camera.position.z};
+                        Vec2f chunk_pos = Vec2f{cast (f32) x * Chunk_Size, cast (f32) z * Chunk_Size};
 
-                        auto current_chunk = world_create_chunk (&g_world, x, z);
+                        if (distance (planar_camera_pos, chunk_pos) >= g_render_distance * Chunk_Size)
+                            continue;
 
-                        if (!current_chunk->generated)
+                        auto current_chunk = world_get_chunk (&g_world, x, z);
+                        if (current_chunk && current_chunk->stage >= Chunk_Stage_Light
+                        && chunk_neighbours_reached_stage (current_chunk, Chunk_Stage_Light))
+                            continue;
+
+                        if (budget <= 0)
                         {
+                            pending_chunk_count += 1;
+
+                            continue;
+                        }
+
+                        s64 time_start = time_current_monotonic ();
+
+                        if (!current_chunk)
+                        {
+                            current_chunk = world_create_chunk (&g_world, x, z);
+
                             g_chunk_creation_time += time_current_monotonic () - time_start;
                             g_chunk_creation_samples += 1;
+                        }
 
-                            chunk_generate (&g_world, current_chunk);
+                        int budget_before = budget;
+                        bool done = world_advance_chunk (&g_world, current_chunk, Chunk_Stage_Mesh, &budget);
+                        if (!done)
+                            pending_chunk_count += 1;
 
-                            s64 time_end = time_current_monotonic ();
-                            g_chunk_generation_time += time_end - time_start;
-                            g_chunk_generation_samples += 1;
-                        }
+                        s64 time_end = time_current_monotonic ();
+                        g_chunk_generation_time += time_end - time_start;
+                        g_chunk_generation_samples += budget_before - budget;
+                        g_frame_generated_chunk_count += budget_before - budget;
+                        g_frame_generation_time += time_end - time_start;
                     }
                 }
             }
+
+            if (g_chunk_generation_budget > 0)
+                generation_debt = max (-budget, 0);
+
+            s64 generated_region_count = g_world.terrain_cache.generated_count - generated_regions_before;
+            g_frame_generated_chunk_count -= cast (int) generated_region_count * Terrain_Region_Generation_Cost;
         }
 
+        world_update_surface_spline_lut (&g_world);
+
+        if (g_far_terrain_enabled)
+            far_terrain_update (&g_world, &g_camera);
+
         int width, height;
         glfwGetFramebufferSize (g_window, &width, &height);
 
@@ -342,9 +975,13 @@ int main (int argc, const char **args)
             glfwMakeContextCurrent (backup_current_context);
         }
 
+        g_frame_work_time = time_current_monotonic () - frame_start;
+
         glfwSwapBuffers (g_window);
 
         g_delta_time = time_current_monotonic () - frame_start;
+
+        update_adaptive_render_distance (pending_chunk_count);
     }
 
     return 0;
@@ -1,8 +1,17 @@
 #include "Minecraft.hpp"
 
-// @Note: we might want to randomly generate this
+#if defined (_M_X64) || defined (__x86_64__)
+#define PERLIN_SIMD 1
+#include <immintrin.h>
+#endif
+
+#if defined (_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Permutation of Ken Perlin's reference implementation, used when no table is given
 static
-const int Perlin_Permutation_Table[512] = {
+const Perlin_Permutation Perlin_Default_Permutation = {{
     151,160,137,91,90,15,
     131,13,201,95,96,53,194,233,7,225,140,36,103,30,69,142,8,99,37,240,21,10,23,
     190, 6,148,247,120,234,75,0,26,197,62,94,252,219,203,117,35,11,32,57,177,33,
@@ -30,7 +39,7 @@ const int Perlin_Permutation_Table[512] = {
     251,34,242,193,238,210,144,12,191,179,162,241, 81,51,145,235,249,14,239,107,
     49,192,214, 31,181,199,106,157,184, 84,204,176,115,121,50,45,127, 4,150,254,
     138,236,205,93,222,114,67,29,24,72,243,141,128,195,78,66,215,61,156,180
-};
+}};
 
 inline
 f64 perlin_fade (f64 t)
@@ -38,22 +47,37 @@ f64 perlin_fade (f64 t)
     return t * t * t * (t * (t * 6 - 15) + 10);
 }
 
+inline
+const u8 *perlin_permutation_values (const Perlin_Permutation *permutations, int octave)
+{
+    return permutations ? permutations[octave].values : Perlin_Default_Permutation.values;
+}
+
+// Gradients selected by the low bits of the hashes, as vectors. They are stored as floats so
+// the lookups do not need a conversion. The 2D gradients only have components of 1 and -1,
+// which the SIMD packs turn into sign flips.
+static const f32 Perlin_Gradients_2D[4][2] = {
+    { 1,  1}, {-1,  1}, {-1, -1}, { 1, -1},
+};
+
+static const f32 Perlin_Gradients_3D[16][3] = {
+    { 1,  1,  0}, {-1,  1,  0}, { 1, -1,  0}, {-1, -1,  0},
+    { 1,  0,  1}, {-1,  0,  1}, { 1,  0, -1}, {-1,  0, -1},
+    { 0,  1,  1}, { 0, -1,  1}, { 0,  1, -1}, { 0, -1, -1},
+    { 1,  1,  0}, { 0, -1,  1}, {-1,  1,  0}, { 0, -1, -1},
+};
+
 inline
 f64 perlin_gradient (int hash, f64 x, f64 y)
 {
-    switch (hash & 0x3)
-    {
-    case 0x0: return  x + y;
-    case 0x1: return -x + y;
-    case 0x2: return -x - y;
-    case 0x3: return  x - y;
-    default:  return 0;
-    }
+    auto g = Perlin_Gradients_2D[hash & 0x3];
+
+    return g[0] * x + g[1] * y;
 }
 
-f64 perlin_noise (f64 x, f64 y)
+f64 perlin_noise (const Perlin_Permutation *permutation, f64 x, f64 y)
 {
-#define P Perlin_Permutation_Table
+#define P permutation->values
 
     int xi = (cast (int) floor (x)) & 255;
     int yi = (cast (int) floor (y)) & 255;
@@ -90,31 +114,14 @@ f64 perlin_noise (f64 x, f64 y)
 inline
 f64 perlin_gradient (int hash, f64 x, f64 y, f64 z)
 {
-    switch (hash & 0xf)
-    {
-    case 0x0: return  x + y;
-    case 0x1: return -x + y;
-    case 0x2: return  x - y;
-    case 0x3: return -x - y;
-    case 0x4: return  x + z;
-    case 0x5: return -x + z;
-    case 0x6: return  x - z;
-    case 0x7: return -x - z;
-    case 0x8: return  y + z;
-    case 0x9: return -y + z;
-    case 0xa: return  y - z;
-    case 0xb: return -y - z;
-    case 0xc: return  y + x;
-    case 0xd: return -y + z;
-    case 0xe: return  y - x;
-    case 0xf: return -y - z;
-    default:  return 0;
-    }
+    auto g = Perlin_Gradients_3D[hash & 0xf];
+
+    return g[0] * x + g[1] * y + g[2] * z;
 }
 
-f64 perlin_noise (f64 x, f64 y, f64 z)
+f64 perlin_noise (const Perlin_Permutation *permutation, f64 x, f64 y, f64 z)
 {
-#define P Perlin_Permutation_Table
+#define P permutation->values
 
     int xi = (cast (int) floor (x)) & 255;
     int yi = (cast (int) floor (y)) & 255;
@@ -188,7 +195,7 @@ f64 perlin_fractal_max (int octaves, f64 persistance)
 }
 
 inline
-f64 perlin_fractal_noise (f64 scale, int octaves, Vec2f *offsets, f64 persistance, f64 lacunarity, f64 x, f64 y)
+f64 perlin_fractal_noise (f64 scale, int octaves, const Vec2f *offsets, const Perlin_Permutation *permutations, f64 persistance, f64 lacunarity, f64 x, f64 y, Noise_Type noise_type)
 {
     if (octaves > Perlin_Fractal_Max_Octaves)
         octaves = Perlin_Fractal_Max_Octaves;
@@ -198,10 +205,15 @@ f64 perlin_fractal_noise (f64 scale, int octaves, Vec2f *offsets, f64 persistanc
     f64 frequency = 1;
     for (int i = 0; i < octaves && amplitude > Perlin_Fractal_Min_Amplitude; i += 1)
     {
-        result += perlin_noise (
-            x * scale * frequency + offsets[i].x,
-            y * scale * frequency + offsets[i].y
-        ) * amplitude;
+        auto permutation = permutations ? &permutations[i] : &Perlin_Default_Permutation;
+        f64 octave_x = x * scale * frequency + offsets[i].x;
+        f64 octave_y = y * scale * frequency + offsets[i].y;
+
+        if (noise_type == Noise_Type_Simplex)
+            result += simplex_noise (permutation, octave_x, octave_y) * amplitude;
+        else
+            result += perlin_noise (permutation, octave_x, octave_y) * amplitude;
+
         amplitude *= persistance;
         frequency *= lacunarity;
     }
@@ -210,13 +222,13 @@ f64 perlin_fractal_noise (f64 scale, int octaves, Vec2f *offsets, f64 persistanc
 }
 
 inline
-f64 perlin_fractal_noise (Perlin_Fractal_Params params, Vec2f *offsets, f64 x, f64 y)
+f64 perlin_fractal_noise (Perlin_Fractal_Params params, const Vec2f *offsets, const Perlin_Permutation *permutations, f64 x, f64 y)
 {
-    return perlin_fractal_noise (params.scale, params.octaves, offsets, params.persistance, params.lacunarity, x, y);
+    return perlin_fractal_noise (params.scale, params.octaves, offsets, permutations, params.persistance, params.lacunarity, x, y, params.noise_type);
 }
 
 inline
-f64 perlin_fractal_noise (f64 scale, int octaves, Vec3f *offsets, f64 persistance, f64 lacunarity, f64 x, f64 y, f64 z)
+f64 perlin_fractal_noise (f64 scale, int octaves, const Vec3f *offsets, const Perlin_Permutation *permutations, f64 persistance, f64 lacunarity, f64 x, f64 y, f64 z, Noise_Type noise_type)
 {
     if (octaves > Perlin_Fractal_Max_Octaves)
         octaves = Perlin_Fractal_Max_Octaves;
@@ -226,11 +238,16 @@ f64 perlin_fractal_noise (f64 scale, int octaves, Vec3f *offsets, f64 persistanc
     f64 frequency = 1;
     for (int i = 0; i < octaves && amplitude > Perlin_Fractal_Min_Amplitude; i += 1)
     {
-        result += perlin_noise (
-            x * scale * frequency + offsets[i].x,
-            y * scale * frequency + offsets[i].y,
-            z * scale * frequency + offsets[i].z
-        ) * amplitude;
+        auto permutation = permutations ? &permutations[i] : &Perlin_Default_Permutation;
+        f64 octave_x = x * scale * frequency + offsets[i].x;
+        f64 octave_y = y * scale * frequency + offsets[i].y;
+        f64 octave_z = z * scale * frequency + offsets[i].z;
+
+        if (noise_type == Noise_Type_Simplex)
+            result += simplex_noise (permutation, octave_x, octave_y, octave_z) * amplitude;
+        else
+            result += perlin_noise (permutation, octave_x, octave_y, octave_z) * amplitude;
+
         amplitude *= persistance;
         frequency *= lacunarity;
     }
@@ -239,9 +256,9 @@ f64 perlin_fractal_noise (f64 scale, int octaves, Vec3f *offsets, f64 persistanc
 }
 
 inline
-f64 perlin_fractal_noise (Perlin_Fractal_Params params, Vec3f *offsets, f64 x, f64 y, f64 z)
+f64 perlin_fractal_noise (Perlin_Fractal_Params params, const Vec3f *offsets, const Perlin_Permutation *permutations, f64 x, f64 y, f64 z)
 {
-    return perlin_fractal_noise (params.scale, params.octaves, offsets, params.persistance, params.lacunarity, x, y, z);
+    return perlin_fractal_noise (params.scale, params.octaves, offsets, permutations, params.persistance, params.lacunarity, x, y, z, params.noise_type);
 }
 
 void perlin_generate_offsets (LC_RNG *rng, int count, Vec2f *offsets)
@@ -262,3 +279,974 @@ void perlin_generate_offsets (LC_RNG *rng, int count, Vec3f *offsets)
         offsets[i].z = random_rangef (rng, -10000, 10000);
     }
 }
+
+// Shuffles the numbers 0 to 255 for each table (Fisher-Yates), and repeats them
+// in the second half so the lookups at a hash + 1 do not have to wrap
+void perlin_generate_permutations (Counter_RNG *rng, int count, Perlin_Permutation *permutations)
+{
+    for_range (i, 0, count)
+    {
+        u8 *values = permutations[i].values;
+        for_range (j, 0, Perlin_Permutation_Size)
+            values[j] = cast (u8) j;
+
+        for (s64 j = Perlin_Permutation_Size - 1; j > 0; j -= 1)
+        {
+            s64 k = random_rangei (rng, 0, cast (u32) j + 1);
+            u8 tmp = values[j];
+            values[j] = values[k];
+            values[k] = tmp;
+        }
+
+        memcpy (values + Perlin_Permutation_Size, values, Perlin_Permutation_Size);
+    }
+}
+
+// Batched fractal noise
+// The batch kernels evaluate all the octaves for a whole strip of samples at once. The math is done
+// on packs of lanes (SSE4.1 or AVX2 registers, or a single value for the scalar fallback), only the
+// permutation table lookups are done lane by lane. The f64 kernels perform the exact same operations
+// as perlin_fractal_noise, so they give bit identical results.
+
+Perlin_Simd_Level g_perlin_simd_level = Perlin_Simd_AVX2;
+
+Perlin_Simd_Level perlin_detect_simd_level ()
+{
+#if defined (PERLIN_SIMD) && defined (_MSC_VER)
+    int info[4];
+    __cpuid (info, 1);
+
+    bool sse41   = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx     = (info[2] & (1 << 28)) != 0;
+
+    __cpuidex (info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0;
+
+    // The OS has to save the YMM registers for us to use them
+    if (avx && avx2 && osxsave && (_xgetbv (0) & 0x6) == 0x6)
+        return Perlin_Simd_AVX2;
+    if (sse41)
+        return Perlin_Simd_SSE4;
+
+    return Perlin_Simd_None;
+#elif defined (PERLIN_SIMD)
+    if (__builtin_cpu_supports ("avx2"))
+        return Perlin_Simd_AVX2;
+    if (__builtin_cpu_supports ("sse4.1"))
+        return Perlin_Simd_SSE4;
+
+    return Perlin_Simd_None;
+#else
+    return Perlin_Simd_None;
+#endif
+}
+
+Perlin_Simd_Level perlin_simd_level ()
+{
+    static Perlin_Simd_Level supported = perlin_detect_simd_level ();
+
+    return cast (Perlin_Simd_Level) min (cast (int) g_perlin_simd_level, cast (int) supported);
+}
+
+const char *perlin_simd_level_name (Perlin_Simd_Level level)
+{
+    switch (level)
+    {
+    case Perlin_Simd_None: return "Scalar";
+    case Perlin_Simd_SSE4: return "SSE4.1";
+    case Perlin_Simd_AVX2: return "AVX2";
+    default: return "";
+    }
+}
+
+#if defined (_MSC_VER)
+#define Perlin_Target_SSE4
+#define Perlin_Target_AVX2
+#else
+#define Perlin_Target_SSE4 __attribute__ ((target ("sse4.1")))
+#define Perlin_Target_AVX2 __attribute__ ((target ("avx2")))
+#endif
+
+// Each pack type provides the arithmetic operators, and:
+// * floor_to_int, which writes the lanes of an already floored pack as integers
+// * max, and greater_equal which gives 1 in the lanes where a >= b and 0 elsewhere
+// * gradient, which computes the dot product of the gradient selected by the hash of each lane
+//   with (x, y), flipping the sign bits instead of multiplying
+
+struct Perlin_F64x1
+{
+    typedef f64 Scalar;
+    static const int Width = 1;
+
+    f64 v;
+
+    static Perlin_F64x1 load (const f64 *p) { return {*p}; }
+    static Perlin_F64x1 set1 (f64 x) { return {x}; }
+    static Perlin_F64x1 floor (Perlin_F64x1 a) { return {::floor (a.v)}; }
+    static Perlin_F64x1 max (Perlin_F64x1 a, Perlin_F64x1 b) { return {a.v > b.v ? a.v : b.v}; }
+    static Perlin_F64x1 greater_equal (Perlin_F64x1 a, Perlin_F64x1 b) { return {a.v >= b.v ? 1.0 : 0.0}; }
+    static Perlin_F64x1 gradient (const s32 *hashes, Perlin_F64x1 x, Perlin_F64x1 y) { return {perlin_gradient (hashes[0], x.v, y.v)}; }
+    void store (f64 *p) const { *p = v; }
+    void floor_to_int (s32 *p) const { *p = cast (s32) v; }
+};
+
+inline Perlin_F64x1 operator+ (Perlin_F64x1 a, Perlin_F64x1 b) { return {a.v + b.v}; }
+inline Perlin_F64x1 operator- (Perlin_F64x1 a, Perlin_F64x1 b) { return {a.v - b.v}; }
+inline Perlin_F64x1 operator* (Perlin_F64x1 a, Perlin_F64x1 b) { return {a.v * b.v}; }
+
+struct Perlin_F32x1
+{
+    typedef f32 Scalar;
+    static const int Width = 1;
+
+    f32 v;
+
+    static Perlin_F32x1 load (const f32 *p) { return {*p}; }
+    static Perlin_F32x1 set1 (f32 x) { return {x}; }
+    static Perlin_F32x1 floor (Perlin_F32x1 a) { return {floorf (a.v)}; }
+    static Perlin_F32x1 max (Perlin_F32x1 a, Perlin_F32x1 b) { return {a.v > b.v ? a.v : b.v}; }
+    static Perlin_F32x1 greater_equal (Perlin_F32x1 a, Perlin_F32x1 b) { return {a.v >= b.v ? 1.0f : 0.0f}; }
+    void store (f32 *p) const { *p = v; }
+    void floor_to_int (s32 *p) const { *p = cast (s32) v; }
+
+    static Perlin_F32x1 gradient (const s32 *hashes, Perlin_F32x1 x, Perlin_F32x1 y)
+    {
+        auto g = Perlin_Gradients_2D[hashes[0] & 0x3];
+
+        return {g[0] * x.v + g[1] * y.v};
+    }
+};
+
+inline Perlin_F32x1 operator+ (Perlin_F32x1 a, Perlin_F32x1 b) { return {a.v + b.v}; }
+inline Perlin_F32x1 operator- (Perlin_F32x1 a, Perlin_F32x1 b) { return {a.v - b.v}; }
+inline Perlin_F32x1 operator* (Perlin_F32x1 a, Perlin_F32x1 b) { return {a.v * b.v}; }
+
+#ifdef PERLIN_SIMD
+
+// The x component of the gradient is negated for hashes 1 and 2, the y component for hashes 2 and 3
+
+struct Perlin_F64x2
+{
+    typedef f64 Scalar;
+    static const int Width = 2;
+
+    __m128d v;
+
+    Perlin_Target_SSE4 static Perlin_F64x2 load (const f64 *p) { return {_mm_loadu_pd (p)}; }
+    Perlin_Target_SSE4 static Perlin_F64x2 set1 (f64 x) { return {_mm_set1_pd (x)}; }
+    Perlin_Target_SSE4 static Perlin_F64x2 floor (Perlin_F64x2 a) { return {_mm_floor_pd (a.v)}; }
+    Perlin_Target_SSE4 static Perlin_F64x2 max (Perlin_F64x2 a, Perlin_F64x2 b) { return {_mm_max_pd (a.v, b.v)}; }
+    Perlin_Target_SSE4 static Perlin_F64x2 greater_equal (Perlin_F64x2 a, Perlin_F64x2 b) { return {_mm_and_pd (_mm_cmpge_pd (a.v, b.v), _mm_set1_pd (1))}; }
+    Perlin_Target_SSE4 void store (f64 *p) const { _mm_storeu_pd (p, v); }
+    Perlin_Target_SSE4 void floor_to_int (s32 *p) const { _mm_storel_epi64 (cast (__m128i *) p, _mm_cvttpd_epi32 (v)); }
+
+    Perlin_Target_SSE4 static Perlin_F64x2 gradient (const s32 *hashes, Perlin_F64x2 x, Perlin_F64x2 y)
+    {
+        __m128i h = _mm_cvtepi32_epi64 (_mm_loadl_epi64 (cast (const __m128i *) hashes));
+        __m128i x_sign = _mm_slli_epi64 (_mm_xor_si128 (h, _mm_srli_epi64 (h, 1)), 63);
+        __m128i y_sign = _mm_slli_epi64 (_mm_srli_epi64 (h, 1), 63);
+
+        return {_mm_add_pd (_mm_xor_pd (x.v, _mm_castsi128_pd (x_sign)), _mm_xor_pd (y.v, _mm_castsi128_pd (y_sign)))};
+    }
+};
+
+Perlin_Target_SSE4 inline Perlin_F64x2 operator+ (Perlin_F64x2 a, Perlin_F64x2 b) { return {_mm_add_pd (a.v, b.v)}; }
+Perlin_Target_SSE4 inline Perlin_F64x2 operator- (Perlin_F64x2 a, Perlin_F64x2 b) { return {_mm_sub_pd (a.v, b.v)}; }
+Perlin_Target_SSE4 inline Perlin_F64x2 operator* (Perlin_F64x2 a, Perlin_F64x2 b) { return {_mm_mul_pd (a.v, b.v)}; }
+
+struct Perlin_F32x4
+{
+    typedef f32 Scalar;
+    static const int Width = 4;
+
+    __m128 v;
+
+    Perlin_Target_SSE4 static Perlin_F32x4 load (const f32 *p) { return {_mm_loadu_ps (p)}; }
+    Perlin_Target_SSE4 static Perlin_F32x4 set1 (f32 x) { return {_mm_set1_ps (x)}; }
+    Perlin_Target_SSE4 static Perlin_F32x4 floor (Perlin_F32x4 a) { return {_mm_floor_ps (a.v)}; }
+    Perlin_Target_SSE4 static Perlin_F32x4 max (Perlin_F32x4 a, Perlin_F32x4 b) { return {_mm_max_ps (a.v, b.v)}; }
+    Perlin_Target_SSE4 static Perlin_F32x4 greater_equal (Perlin_F32x4 a, Perlin_F32x4 b) { return {_mm_and_ps (_mm_cmpge_ps (a.v, b.v), _mm_set1_ps (1))}; }
+    Perlin_Target_SSE4 void store (f32 *p) const { _mm_storeu_ps (p, v); }
+    Perlin_Target_SSE4 void floor_to_int (s32 *p) const { _mm_storeu_si128 (cast (__m128i *) p, _mm_cvttps_epi32 (v)); }
+
+    Perlin_Target_SSE4 static Perlin_F32x4 gradient (const s32 *hashes, Perlin_F32x4 x, Perlin_F32x4 y)
+    {
+        __m128i h = _mm_loadu_si128 (cast (const __m128i *) hashes);
+        __m128i x_sign = _mm_slli_epi32 (_mm_xor_si128 (h, _mm_srli_epi32 (h, 1)), 31);
+        __m128i y_sign = _mm_slli_epi32 (_mm_srli_epi32 (h, 1), 31);
+
+        return {_mm_add_ps (_mm_xor_ps (x.v, _mm_castsi128_ps (x_sign)), _mm_xor_ps (y.v, _mm_castsi128_ps (y_sign)))};
+    }
+};
+
+Perlin_Target_SSE4 inline Perlin_F32x4 operator+ (Perlin_F32x4 a, Perlin_F32x4 b) { return {_mm_add_ps (a.v, b.v)}; }
+Perlin_Target_SSE4 inline Perlin_F32x4 operator- (Perlin_F32x4 a, Perlin_F32x4 b) { return {_mm_sub_ps (a.v, b.v)}; }
+Perlin_Target_SSE4 inline Perlin_F32x4 operator* (Perlin_F32x4 a, Perlin_F32x4 b) { return {_mm_mul_ps (a.v, b.v)}; }
+
+struct Perlin_F64x4
+{
+    typedef f64 Scalar;
+    static const int Width = 4;
+
+    __m256d v;
+
+    Perlin_Target_AVX2 static Perlin_F64x4 load (const f64 *p) { return {_mm256_loadu_pd (p)}; }
+    Perlin_Target_AVX2 static Perlin_F64x4 set1 (f64 x) { return {_mm256_set1_pd (x)}; }
+    Perlin_Target_AVX2 static Perlin_F64x4 floor (Perlin_F64x4 a) { return {_mm256_floor_pd (a.v)}; }
+    Perlin_Target_AVX2 static Perlin_F64x4 max (Perlin_F64x4 a, Perlin_F64x4 b) { return {_mm256_max_pd (a.v, b.v)}; }
+    Perlin_Target_AVX2 static Perlin_F64x4 greater_equal (Perlin_F64x4 a, Perlin_F64x4 b) { return {_mm256_and_pd (_mm256_cmp_pd (a.v, b.v, _CMP_GE_OQ), _mm256_set1_pd (1))}; }
+    Perlin_Target_AVX2 void store (f64 *p) const { _mm256_storeu_pd (p, v); }
+    Perlin_Target_AVX2 void floor_to_int (s32 *p) const { _mm_storeu_si128 (cast (__m128i *) p, _mm256_cvttpd_epi32 (v)); }
+
+    Perlin_Target_AVX2 static Perlin_F64x4 gradient (const s32 *hashes, Perlin_F64x4 x, Perlin_F64x4 y)
+    {
+        __m256i h = _mm256_cvtepi32_epi64 (_mm_loadu_si128 (cast (const __m128i *) hashes));
+        __m256i x_sign = _mm256_slli_epi64 (_mm256_xor_si256 (h, _mm256_srli_epi64 (h, 1)), 63);
+        __m256i y_sign = _mm256_slli_epi64 (_mm256_srli_epi64 (h, 1), 63);
+
+        return {_mm256_add_pd (_mm256_xor_pd (x.v, _mm256_castsi256_pd (x_sign)), _mm256_xor_pd (y.v, _mm256_castsi256_pd (y_sign)))};
+    }
+};
+
+Perlin_Target_AVX2 inline Perlin_F64x4 operator+ (Perlin_F64x4 a, Perlin_F64x4 b) { return {_mm256_add_pd (a.v, b.v)}; }
+Perlin_Target_AVX2 inline Perlin_F64x4 operator- (Perlin_F64x4 a, Perlin_F64x4 b) { return {_mm256_sub_pd (a.v, b.v)}; }
+Perlin_Target_AVX2 inline Perlin_F64x4 operator* (Perlin_F64x4 a, Perlin_F64x4 b) { return {_mm256_mul_pd (a.v, b.v)}; }
+
+struct Perlin_F32x8
+{
+    typedef f32 Scalar;
+    static const int Width = 8;
+
+    __m256 v;
+
+    Perlin_Target_AVX2 static Perlin_F32x8 load (const f32 *p) { return {_mm256_loadu_ps (p)}; }
+    Perlin_Target_AVX2 static Perlin_F32x8 set1 (f32 x) { return {_mm256_set1_ps (x)}; }
+    Perlin_Target_AVX2 static Perlin_F32x8 floor (Perlin_F32x8 a) { return {_mm256_floor_ps (a.v)}; }
+    Perlin_Target_AVX2 static Perlin_F32x8 max (Perlin_F32x8 a, Perlin_F32x8 b) { return {_mm256_max_ps (a.v, b.v)}; }
+    Perlin_Target_AVX2 static Perlin_F32x8 greater_equal (Perlin_F32x8 a, Perlin_F32x8 b) { return {_mm256_and_ps (_mm256_cmp_ps (a.v, b.v, _CMP_GE_OQ), _mm256_set1_ps (1))}; }
+    Perlin_Target_AVX2 void store (f32 *p) const { _mm256_storeu_ps (p, v); }
+    Perlin_Target_AVX2 void floor_to_int (s32 *p) const { _mm256_storeu_si256 (cast (__m256i *) p, _mm256_cvttps_epi32 (v)); }
+
+    Perlin_Target_AVX2 static Perlin_F32x8 gradient (const s32 *hashes, Perlin_F32x8 x, Perlin_F32x8 y)
+    {
+        __m256i h = _mm256_loadu_si256 (cast (const __m256i *) hashes);
+        __m256i x_sign = _mm256_slli_epi32 (_mm256_xor_si256 (h, _mm256_srli_epi32 (h, 1)), 31);
+        __m256i y_sign = _mm256_slli_epi32 (_mm256_srli_epi32 (h, 1), 31);
+
+        return {_mm256_add_ps (_mm256_xor_ps (x.v, _mm256_castsi256_ps (x_sign)), _mm256_xor_ps (y.v, _mm256_castsi256_ps (y_sign)))};
+    }
+};
+
+Perlin_Target_AVX2 inline Perlin_F32x8 operator+ (Perlin_F32x8 a, Perlin_F32x8 b) { return {_mm256_add_ps (a.v, b.v)}; }
+Perlin_Target_AVX2 inline Perlin_F32x8 operator- (Perlin_F32x8 a, Perlin_F32x8 b) { return {_mm256_sub_ps (a.v, b.v)}; }
+Perlin_Target_AVX2 inline Perlin_F32x8 operator* (Perlin_F32x8 a, Perlin_F32x8 b) { return {_mm256_mul_ps (a.v, b.v)}; }
+
+#endif
+
+template<typename Pack>
+inline
+Pack perlin_fade (Pack t)
+{
+    return t * t * t * (t * (t * Pack::set1 (6) - Pack::set1 (15)) + Pack::set1 (10));
+}
+
+template<typename Pack>
+inline
+Pack perlin_lerp (Pack a, Pack b, Pack t)
+{
+    return a + t * (b - a);
+}
+
+template<typename Pack>
+Pack perlin_noise (const u8 *permutation, Pack x, Pack y)
+{
+#define P permutation
+
+    const int Width = Pack::Width;
+
+    Pack x_floor = Pack::floor (x);
+    Pack y_floor = Pack::floor (y);
+    Pack xf = x - x_floor;
+    Pack yf = y - y_floor;
+
+    s32 xis[Width];
+    s32 yis[Width];
+    x_floor.floor_to_int (xis);
+    y_floor.floor_to_int (yis);
+
+    // Hashes of the 4 corners
+    s32 aa[Width], ba[Width], ab[Width], bb[Width];
+    for_range (i, 0, Width)
+    {
+        int xi = xis[i] & 255;
+        int yi = yis[i] & 255;
+
+        aa[i] = P[P[xi    ] + yi    ];
+        ba[i] = P[P[xi + 1] + yi    ];
+        ab[i] = P[P[xi    ] + yi + 1];
+        bb[i] = P[P[xi + 1] + yi + 1];
+    }
+
+    auto u = perlin_fade (xf);
+    auto v = perlin_fade (yf);
+
+    Pack one = Pack::set1 (1);
+    Pack xf1 = xf - one;
+    Pack yf1 = yf - one;
+
+    Pack x1 = perlin_lerp (Pack::gradient (aa, xf, yf), Pack::gradient (ba, xf1, yf), u);
+    Pack x2 = perlin_lerp (Pack::gradient (ab, xf, yf1), Pack::gradient (bb, xf1, yf1), u);
+
+    return perlin_lerp (x1, x2, v);
+
+#undef P
+}
+
+// The gradient components are gathered lane by lane, since the 3D gradients do not reduce to sign flips
+template<typename Pack>
+inline
+Pack perlin_gradient (const s32 *hashes, Pack x, Pack y, Pack z)
+{
+    typedef typename Pack::Scalar Scalar;
+    const int Width = Pack::Width;
+
+    Scalar gx[Width], gy[Width], gz[Width];
+    for_range (i, 0, Width)
+    {
+        auto g = Perlin_Gradients_3D[hashes[i] & 0xf];
+        gx[i] = g[0];
+        gy[i] = g[1];
+        gz[i] = g[2];
+    }
+
+    return Pack::load (gx) * x + Pack::load (gy) * y + Pack::load (gz) * z;
+}
+
+template<typename Pack>
+Pack perlin_noise (const u8 *permutation, Pack x, Pack y, Pack z)
+{
+#define P permutation
+
+    const int Width = Pack::Width;
+
+    Pack x_floor = Pack::floor (x);
+    Pack y_floor = Pack::floor (y);
+    Pack z_floor = Pack::floor (z);
+    Pack xf = x - x_floor;
+    Pack yf = y - y_floor;
+    Pack zf = z - z_floor;
+
+    s32 xis[Width];
+    s32 yis[Width];
+    s32 zis[Width];
+    x_floor.floor_to_int (xis);
+    y_floor.floor_to_int (yis);
+    z_floor.floor_to_int (zis);
+
+    // Hashes of the 8 corners
+    s32 aaa[Width], aba[Width], aab[Width], abb[Width];
+    s32 baa[Width], bba[Width], bab[Width], bbb[Width];
+    for_range (i, 0, Width)
+    {
+        int xi = xis[i] & 255;
+        int yi = yis[i] & 255;
+        int zi = zis[i] & 255;
+
+        aaa[i] = P[P[P[xi    ] + yi    ] + zi    ];
+        aba[i] = P[P[P[xi    ] + yi + 1] + zi    ];
+        aab[i] = P[P[P[xi    ] + yi    ] + zi + 1];
+        abb[i] = P[P[P[xi    ] + yi + 1] + zi + 1];
+        baa[i] = P[P[P[xi + 1] + yi    ] + zi    ];
+        bba[i] = P[P[P[xi + 1] + yi + 1] + zi    ];
+        bab[i] = P[P[P[xi + 1] + yi    ] + zi + 1];
+        bbb[i] = P[P[P[xi + 1] + yi + 1] + zi + 1];
+    }
+
+    auto u = perlin_fade (xf);
+    auto v = perlin_fade (yf);
+    auto w = perlin_fade (zf);
+
+    Pack one = Pack::set1 (1);
+    Pack xf1 = xf - one;
+    Pack yf1 = yf - one;
+    Pack zf1 = zf - one;
+
+    Pack x1 = perlin_lerp (perlin_gradient (aaa, xf, yf, zf), perlin_gradient (baa, xf1, yf, zf), u);
+    Pack x2 = perlin_lerp (perlin_gradient (aba, xf, yf1, zf), perlin_gradient (bba, xf1, yf1, zf), u);
+    Pack y1 = perlin_lerp (x1, x2, v);
+
+    x1 = perlin_lerp (perlin_gradient (aab, xf, yf, zf1), perlin_gradient (bab, xf1, yf, zf1), u);
+    x2 = perlin_lerp (perlin_gradient (abb, xf, yf1, zf1), perlin_gradient (bbb, xf1, yf1, zf1), u);
+    Pack y2 = perlin_lerp (x1, x2, v);
+
+    return perlin_lerp (y1, y2, w);
+
+#undef P
+}
+
+// Simplex noise
+// The samples are placed in a lattice of triangles (tetrahedra in 3D) instead of squares, so only
+// 3 (4) corners contribute to a sample instead of 4 (8), and there is no interpolation, each
+// corner contributes a radially attenuated gradient. The corners use the same hashes and
+// gradients as Perlin noise. The lanes select their corners with masks instead of branches,
+// which also makes the scalar versions follow the exact same path as the packs.
+
+static const f64 Simplex_Skew_2D   = 0.36602540378443864676; // (sqrt (3) - 1) / 2
+static const f64 Simplex_Unskew_2D = 0.21132486540518711775; // (3 - sqrt (3)) / 6
+static const f64 Simplex_Skew_3D   = 1.0 / 3.0;
+static const f64 Simplex_Unskew_3D = 1.0 / 6.0;
+
+// Scales bringing the result in about [-1, 1], measured on random samples
+static const f64 Simplex_Scale_2D = 70;
+static const f64 Simplex_Scale_3D = 76;
+
+template<typename Pack>
+inline
+Pack simplex_attenuation (Pack x, Pack y)
+{
+    typedef typename Pack::Scalar Scalar;
+
+    Pack t = Pack::max (Pack::set1 (cast (Scalar) 0.5) - x * x - y * y, Pack::set1 (0));
+    t = t * t;
+
+    return t * t;
+}
+
+template<typename Pack>
+inline
+Pack simplex_attenuation (Pack x, Pack y, Pack z)
+{
+    typedef typename Pack::Scalar Scalar;
+
+    Pack t = Pack::max (Pack::set1 (cast (Scalar) 0.5) - x * x - y * y - z * z, Pack::set1 (0));
+    t = t * t;
+
+    return t * t;
+}
+
+template<typename Pack>
+Pack simplex_noise (const u8 *permutation, Pack x, Pack y)
+{
+#define P permutation
+
+    typedef typename Pack::Scalar Scalar;
+    const int Width = Pack::Width;
+
+    Pack one = Pack::set1 (1);
+    Pack unskew = Pack::set1 (cast (Scalar) Simplex_Unskew_2D);
+
+    // Cell of the skewed lattice, and position relative to its first corner
+    Pack s = (x + y) * Pack::set1 (cast (Scalar) Simplex_Skew_2D);
+    Pack i = Pack::floor (x + s);
+    Pack j = Pack::floor (y + s);
+    Pack t = (i + j) * unskew;
+    Pack x0 = x - (i - t);
+    Pack y0 = y - (j - t);
+
+    // The second corner is (1, 0) in the lower triangle of the cell and (0, 1) in the upper one
+    Pack i1 = Pack::greater_equal (x0, y0);
+    Pack j1 = one - i1;
+
+    Pack x1 = x0 - i1 + unskew;
+    Pack y1 = y0 - j1 + unskew;
+    Pack x2 = x0 - one + unskew + unskew;
+    Pack y2 = y0 - one + unskew + unskew;
+
+    s32 is[Width], js[Width], i1s[Width];
+    i.floor_to_int (is);
+    j.floor_to_int (js);
+    i1.floor_to_int (i1s);
+
+    s32 h0[Width], h1[Width], h2[Width];
+    for_range (l, 0, Width)
+    {
+        int ii = is[l] & 255;
+        int jj = js[l] & 255;
+        int di = i1s[l];
+
+        h0[l] = P[P[ii     ] + jj         ];
+        h1[l] = P[P[ii + di] + jj + 1 - di];
+        h2[l] = P[P[ii + 1 ] + jj + 1     ];
+    }
+
+    Pack n0 = simplex_attenuation (x0, y0) * Pack::gradient (h0, x0, y0);
+    Pack n1 = simplex_attenuation (x1, y1) * Pack::gradient (h1, x1, y1);
+    Pack n2 = simplex_attenuation (x2, y2) * Pack::gradient (h2, x2, y2);
+
+    return (n0 + n1 + n2) * Pack::set1 (cast (Scalar) Simplex_Scale_2D);
+
+#undef P
+}
+
+template<typename Pack>
+Pack simplex_noise (const u8 *permutation, Pack x, Pack y, Pack z)
+{
+#define P permutation
+
+    typedef typename Pack::Scalar Scalar;
+    const int Width = Pack::Width;
+
+    Pack one = Pack::set1 (1);
+    Pack unskew = Pack::set1 (cast (Scalar) Simplex_Unskew_3D);
+
+    Pack s = (x + y + z) * Pack::set1 (cast (Scalar) Simplex_Skew_3D);
+    Pack i = Pack::floor (x + s);
+    Pack j = Pack::floor (y + s);
+    Pack k = Pack::floor (z + s);
+    Pack t = (i + j + k) * unskew;
+    Pack x0 = x - (i - t);
+    Pack y0 = y - (j - t);
+    Pack z0 = z - (k - t);
+
+    // The tetrahedron is found by ranking the coordinates. The second corner steps along
+    // the largest one, the third along the two largest ones.
+    Pack x_ge_y = Pack::greater_equal (x0, y0);
+    Pack y_ge_z = Pack::greater_equal (y0, z0);
+    Pack x_ge_z = Pack::greater_equal (x0, z0);
+    Pack x_lt_y = one - x_ge_y;
+    Pack y_lt_z = one - y_ge_z;
+    Pack x_lt_z = one - x_ge_z;
+
+    Pack i1 = x_ge_y * x_ge_z;
+    Pack j1 = x_lt_y * y_ge_z;
+    Pack k1 = y_lt_z * x_lt_z;
+    Pack i2 = x_ge_y + x_ge_z - i1;
+    Pack j2 = x_lt_y + y_ge_z - j1;
+    Pack k2 = y_lt_z + x_lt_z - k1;
+
+    Pack x1 = x0 - i1 + unskew;
+    Pack y1 = y0 - j1 + unskew;
+    Pack z1 = z0 - k1 + unskew;
+    Pack x2 = x0 - i2 + unskew + unskew;
+    Pack y2 = y0 - j2 + unskew + unskew;
+    Pack z2 = z0 - k2 + unskew + unskew;
+    Pack x3 = x0 - one + unskew + unskew + unskew;
+    Pack y3 = y0 - one + unskew + unskew + unskew;
+    Pack z3 = z0 - one + unskew + unskew + unskew;
+
+    s32 is[Width], js[Width], ks[Width];
+    s32 i1s[Width], j1s[Width], k1s[Width];
+    s32 i2s[Width], j2s[Width], k2s[Width];
+    i.floor_to_int (is);
+    j.floor_to_int (js);
+    k.floor_to_int (ks);
+    i1.floor_to_int (i1s);
+    j1.floor_to_int (j1s);
+    k1.floor_to_int (k1s);
+    i2.floor_to_int (i2s);
+    j2.floor_to_int (j2s);
+    k2.floor_to_int (k2s);
+
+    s32 h0[Width], h1[Width], h2[Width], h3[Width];
+    for_range (l, 0, Width)
+    {
+        int ii = is[l] & 255;
+        int jj = js[l] & 255;
+        int kk = ks[l] & 255;
+
+        h0[l] = P[P[P[ii          ] + jj          ] + kk          ];
+        h1[l] = P[P[P[ii + i1s[l] ] + jj + j1s[l] ] + kk + k1s[l] ];
+        h2[l] = P[P[P[ii + i2s[l] ] + jj + j2s[l] ] + kk + k2s[l] ];
+        h3[l] = P[P[P[ii + 1      ] + jj + 1      ] + kk + 1      ];
+    }
+
+    Pack n0 = simplex_attenuation (x0, y0, z0) * perlin_gradient (h0, x0, y0, z0);
+    Pack n1 = simplex_attenuation (x1, y1, z1) * perlin_gradient (h1, x1, y1, z1);
+    Pack n2 = simplex_attenuation (x2, y2, z2) * perlin_gradient (h2, x2, y2, z2);
+    Pack n3 = simplex_attenuation (x3, y3, z3) * perlin_gradient (h3, x3, y3, z3);
+
+    return (n0 + n1 + n2 + n3) * Pack::set1 (cast (Scalar) Simplex_Scale_3D);
+
+#undef P
+}
+
+f64 simplex_noise (const Perlin_Permutation *permutation, f64 x, f64 y)
+{
+    return simplex_noise (permutation->values, Perlin_F64x1{x}, Perlin_F64x1{y}).v;
+}
+
+f64 simplex_noise (const Perlin_Permutation *permutation, f64 x, f64 y, f64 z)
+{
+    return simplex_noise (permutation->values, Perlin_F64x1{x}, Perlin_F64x1{y}, Perlin_F64x1{z}).v;
+}
+
+template<typename Pack>
+Pack perlin_fractal_noise (const Perlin_Fractal_Params &params, int octaves, const Vec2f *offsets, const Perlin_Permutation *permutations, Pack x, Pack y)
+{
+    typedef typename Pack::Scalar Scalar;
+
+    Pack scale = Pack::set1 (cast (Scalar) params.scale);
+    Pack result = Pack::set1 (0);
+    f64 amplitude = 1;
+    f64 frequency = 1;
+    for (int i = 0; i < octaves && amplitude > Perlin_Fractal_Min_Amplitude; i += 1)
+    {
+        Pack octave_frequency = Pack::set1 (cast (Scalar) frequency);
+        Pack octave_x = x * scale * octave_frequency + Pack::set1 (cast (Scalar) offsets[i].x);
+        Pack octave_y = y * scale * octave_frequency + Pack::set1 (cast (Scalar) offsets[i].y);
+
+        auto permutation = perlin_permutation_values (permutations, i);
+        Pack noise;
+        if (params.noise_type == Noise_Type_Simplex)
+            noise = simplex_noise (permutation, octave_x, octave_y);
+        else
+            noise = perlin_noise (permutation, octave_x, octave_y);
+
+        result = result + noise * Pack::set1 (cast (Scalar) amplitude);
+        amplitude *= params.persistance;
+        frequency *= params.lacunarity;
+    }
+
+    return result;
+}
+
+template<typename Pack>
+void perlin_fractal_noise_batch_kernel (const Perlin_Fractal_Params &params, const Vec2f *offsets, const Perlin_Permutation *permutations, s64 count,
+    const typename Pack::Scalar *xs, const typename Pack::Scalar *ys, typename Pack::Scalar *results)
+{
+    typedef typename Pack::Scalar Scalar;
+    const int Width = Pack::Width;
+
+    int octaves = min (params.octaves, Perlin_Fractal_Max_Octaves);
+
+    s64 i = 0;
+    for (; i + Width <= count; i += Width)
+    {
+        auto noise = perlin_fractal_noise (params, octaves, offsets, permutations, Pack::load (xs + i), Pack::load (ys + i));
+        noise.store (results + i);
+    }
+
+    // Remaining samples that do not fill a whole pack
+    if (i < count)
+    {
+        Scalar x_lanes[Width] = {};
+        Scalar y_lanes[Width] = {};
+        Scalar result_lanes[Width];
+        for_range (j, i, count)
+        {
+            x_lanes[j - i] = xs[j];
+            y_lanes[j - i] = ys[j];
+        }
+
+        auto noise = perlin_fractal_noise (params, octaves, offsets, permutations, Pack::load (x_lanes), Pack::load (y_lanes));
+        noise.store (result_lanes);
+
+        for_range (j, i, count)
+            results[j] = result_lanes[j - i];
+    }
+}
+
+template<typename Pack>
+Pack perlin_fractal_noise (const Perlin_Fractal_Params &params, int octaves, const Vec3f *offsets, const Perlin_Permutation *permutations, Pack x, Pack y, Pack z)
+{
+    typedef typename Pack::Scalar Scalar;
+
+    Pack scale = Pack::set1 (cast (Scalar) params.scale);
+    Pack result = Pack::set1 (0);
+    f64 amplitude = 1;
+    f64 frequency = 1;
+    for (int i = 0; i < octaves && amplitude > Perlin_Fractal_Min_Amplitude; i += 1)
+    {
+        Pack octave_frequency = Pack::set1 (cast (Scalar) frequency);
+        Pack octave_x = x * scale * octave_frequency + Pack::set1 (cast (Scalar) offsets[i].x);
+        Pack octave_y = y * scale * octave_frequency + Pack::set1 (cast (Scalar) offsets[i].y);
+        Pack octave_z = z * scale * octave_frequency + Pack::set1 (cast (Scalar) offsets[i].z);
+
+        auto permutation = perlin_permutation_values (permutations, i);
+        Pack noise;
+        if (params.noise_type == Noise_Type_Simplex)
+            noise = simplex_noise (permutation, octave_x, octave_y, octave_z);
+        else
+            noise = perlin_noise (permutation, octave_x, octave_y, octave_z);
+
+        result = result + noise * Pack::set1 (cast (Scalar) amplitude);
+        amplitude *= params.persistance;
+        frequency *= params.lacunarity;
+    }
+
+    return result;
+}
+
+template<typename Pack>
+void perlin_fractal_noise_batch_kernel (const Perlin_Fractal_Params &params, const Vec3f *offsets, const Perlin_Permutation *permutations, s64 count,
+    const typename Pack::Scalar *xs, const typename Pack::Scalar *ys, const typename Pack::Scalar *zs, typename Pack::Scalar *results)
+{
+    typedef typename Pack::Scalar Scalar;
+    const int Width = Pack::Width;
+
+    int octaves = min (params.octaves, Perlin_Fractal_Max_Octaves);
+
+    s64 i = 0;
+    for (; i + Width <= count; i += Width)
+    {
+        auto noise = perlin_fractal_noise (params, octaves, offsets, permutations, Pack::load (xs + i), Pack::load (ys + i), Pack::load (zs + i));
+        noise.store (results + i);
+    }
+
+    // Remaining samples that do not fill a whole pack
+    if (i < count)
+    {
+        Scalar x_lanes[Width] = {};
+        Scalar y_lanes[Width] = {};
+        Scalar z_lanes[Width] = {};
+        Scalar result_lanes[Width];
+        for_range (j, i, count)
+        {
+            x_lanes[j - i] = xs[j];
+            y_lanes[j - i] = ys[j];
+            z_lanes[j - i] = zs[j];
+        }
+
+        auto noise = perlin_fractal_noise (params, octaves, offsets, permutations, Pack::load (x_lanes), Pack::load (y_lanes), Pack::load (z_lanes));
+        noise.store (result_lanes);
+
+        for_range (j, i, count)
+            results[j] = result_lanes[j - i];
+    }
+}
+
+void perlin_fractal_noise_batch (Perlin_Fractal_Params params, const Vec2f *offsets, const Perlin_Permutation *permutations, s64 count, const f64 *xs, const f64 *ys, f64 *results)
+{
+    switch (perlin_simd_level ())
+    {
+#ifdef PERLIN_SIMD
+    case Perlin_Simd_AVX2:
+        perlin_fractal_noise_batch_kernel<Perlin_F64x4> (params, offsets, permutations, count, xs, ys, results);
+        break;
+
+    case Perlin_Simd_SSE4:
+        perlin_fractal_noise_batch_kernel<Perlin_F64x2> (params, offsets, permutations, count, xs, ys, results);
+        break;
+#endif
+
+    default:
+        perlin_fractal_noise_batch_kernel<Perlin_F64x1> (params, offsets, permutations, count, xs, ys, results);
+        break;
+    }
+}
+
+void perlin_fractal_noise_batch (Perlin_Fractal_Params params, const Vec2f *offsets, const Perlin_Permutation *permutations, s64 count, const f32 *xs, const f32 *ys, f32 *results)
+{
+    switch (perlin_simd_level ())
+    {
+#ifdef PERLIN_SIMD
+    case Perlin_Simd_AVX2:
+        perlin_fractal_noise_batch_kernel<Perlin_F32x8> (params, offsets, permutations, count, xs, ys, results);
+        break;
+
+    case Perlin_Simd_SSE4:
+        perlin_fractal_noise_batch_kernel<Perlin_F32x4> (params, offsets, permutations, count, xs, ys, results);
+        break;
+#endif
+
+    default:
+        perlin_fractal_noise_batch_kernel<Perlin_F32x1> (params, offsets, permutations, count, xs, ys, results);
+        break;
+    }
+}
+
+void perlin_fractal_noise_batch (Perlin_Fractal_Params params, const Vec3f *offsets, const Perlin_Permutation *permutations, s64 count, const f32 *xs, const f32 *ys, const f32 *zs, f32 *results)
+{
+    switch (perlin_simd_level ())
+    {
+#ifdef PERLIN_SIMD
+    case Perlin_Simd_AVX2:
+        perlin_fractal_noise_batch_kernel<Perlin_F32x8> (params, offsets, permutations, count, xs, ys, zs, results);
+        break;
+
+    case Perlin_Simd_SSE4:
+        perlin_fractal_noise_batch_kernel<Perlin_F32x4> (params, offsets, permutations, count, xs, ys, zs, results);
+        break;
+#endif
+
+    default:
+        perlin_fractal_noise_batch_kernel<Perlin_F32x1> (params, offsets, permutations, count, xs, ys, zs, results);
+        break;
+    }
+}
+
+// Results are stored as results[x * height + y], which is the layout of the terrain values of a chunk
+void perlin_fractal_noise_grid (Perlin_Fractal_Params params, const Vec2f *offsets, const Perlin_Permutation *permutations, f64 start_x, f64 start_y, int width, int height, f64 *results)
+{
+    auto state = arena_get_state (&frame_arena);
+    defer (arena_set_state (&frame_arena, state));
+
+    s64 count = cast (s64) width * height;
+    f64 *xs = mem_alloc_uninit (f64, count, frame_allocator);
+    f64 *ys = mem_alloc_uninit (f64, count, frame_allocator);
+    for_range (x, 0, width)
+    {
+        for_range (y, 0, height)
+        {
+            xs[x * height + y] = start_x + x;
+            ys[x * height + y] = start_y + y;
+        }
+    }
+
+    perlin_fractal_noise_batch (params, offsets, permutations, count, xs, ys, results);
+}
+
+void perlin_fractal_noise_grid (Perlin_Fractal_Params params, const Vec2f *offsets, const Perlin_Permutation *permutations, f32 start_x, f32 start_y, int width, int height, f32 *results)
+{
+    auto state = arena_get_state (&frame_arena);
+    defer (arena_set_state (&frame_arena, state));
+
+    s64 count = cast (s64) width * height;
+    f32 *xs = mem_alloc_uninit (f32, count, frame_allocator);
+    f32 *ys = mem_alloc_uninit (f32, count, frame_allocator);
+    for_range (x, 0, width)
+    {
+        for_range (y, 0, height)
+        {
+            xs[x * height + y] = start_x + x;
+            ys[x * height + y] = start_y + y;
+        }
+    }
+
+    perlin_fractal_noise_batch (params, offsets, permutations, count, xs, ys, results);
+}
+
+// Compares the scalar path with the batched kernels on chunk sized grids, for each SIMD level
+// supported by the CPU. The results are printed to the console.
+void perlin_benchmark (int grid_count)
+{
+    LC_RNG rng;
+    random_seed (&rng, 12345);
+
+    Vec2f offsets[Perlin_Fractal_Max_Octaves];
+    perlin_generate_offsets (&rng, Perlin_Fractal_Max_Octaves, offsets);
+
+    Counter_RNG permutation_rng;
+    random_seed (&permutation_rng, 12345);
+
+    Perlin_Permutation permutations[Perlin_Fractal_Max_Octaves];
+    perlin_generate_permutations (&permutation_rng, Perlin_Fractal_Max_Octaves, permutations);
+
+    f64 scalar_results[Chunk_Size * Chunk_Size];
+    f64 batch_results[Chunk_Size * Chunk_Size];
+    f32 batch_results_f32[Chunk_Size * Chunk_Size];
+
+    auto previous_level = g_perlin_simd_level;
+    defer (g_perlin_simd_level = previous_level);
+
+    g_perlin_simd_level = Perlin_Simd_AVX2;
+    auto supported_level = perlin_simd_level ();
+
+    println ("Perlin benchmark, %d grids of %dx%d samples, supported SIMD level: %s", grid_count, Chunk_Size, Chunk_Size, perlin_simd_level_name (supported_level));
+
+    // Each of the default params, with each noise type
+    for_range (i, 0, cast (s64) array_size (Default_Perlin_Params) * Noise_Type_Count)
+    {
+        s64 p = i / Noise_Type_Count;
+        auto params = Default_Perlin_Params[p];
+        params.noise_type = cast (Noise_Type) (i % Noise_Type_Count);
+
+        s64 scalar_time = 0;
+        f64 checksum = 0;
+        {
+            s64 start = time_current_monotonic ();
+            for_range (g, 0, grid_count)
+            {
+                for_range (x, 0, Chunk_Size)
+                {
+                    for_range (y, 0, Chunk_Size)
+                    {
+                        scalar_results[x * Chunk_Size + y] = perlin_fractal_noise (params, offsets, permutations, g * Chunk_Size + x, y);
+                    }
+                }
+
+                checksum += scalar_results[0];
+            }
+            scalar_time = time_current_monotonic () - start;
+        }
+
+        println ("  Params %lld (%d octaves, %s): scalar f64 %.3f us/grid (checksum %f)", p, params.octaves, Noise_Type_Names[params.noise_type], scalar_time / cast (f64) grid_count, checksum);
+
+        for_range (level, 0, supported_level + 1)
+        {
+            g_perlin_simd_level = cast (Perlin_Simd_Level) level;
+
+            f64 max_error = 0;
+            f64 max_error_f32 = 0;
+
+            s64 start = time_current_monotonic ();
+            for_range (g, 0, grid_count)
+                perlin_fractal_noise_grid (params, offsets, permutations, cast (f64) g * Chunk_Size, 0.0, Chunk_Size, Chunk_Size, batch_results);
+            s64 batch_time = time_current_monotonic () - start;
+
+            start = time_current_monotonic ();
+            for_range (g, 0, grid_count)
+                perlin_fractal_noise_grid (params, offsets, permutations, cast (f32) g * Chunk_Size, 0.0f, Chunk_Size, Chunk_Size, batch_results_f32);
+            s64 batch_time_f32 = time_current_monotonic () - start;
+
+            // Compare the last grid against the scalar results computed for it above
+            for_range (i, 0, Chunk_Size * Chunk_Size)
+            {
+                max_error = max (max_error, fabs (batch_results[i] - scalar_results[i]));
+                max_error_f32 = max (max_error_f32, fabs (batch_results_f32[i] - scalar_results[i]));
+            }
+
+            println ("    %-6s f64 %.3f us/grid (x%.2f, max error %g), f32 %.3f us/grid (x%.2f, max error %g)",
+                perlin_simd_level_name (g_perlin_simd_level),
+                batch_time / cast (f64) grid_count, scalar_time / cast (f64) max (batch_time, cast (s64) 1), max_error,
+                batch_time_f32 / cast (f64) grid_count, scalar_time / cast (f64) max (batch_time_f32, cast (s64) 1), max_error_f32);
+        }
+    }
+
+    // 3D noise on the density lattice of a chunk section (5x5x3 samples per section, as in
+    // chunk_generate_density), which is where the number of corners matters the most
+    {
+        static const int Lattice_Width = Chunk_Size / Density_Cell_Size + 1;
+        static const int Lattice_Height = Chunk_Section_Height / Density_Cell_Height + 1;
+        static const int Lattice_Count = Lattice_Width * Lattice_Width * Lattice_Height;
+
+        Vec3f offsets_3d[Perlin_Fractal_Max_Octaves];
+        perlin_generate_offsets (&rng, Perlin_Fractal_Max_Octaves, offsets_3d);
+
+        f32 xs[Lattice_Count], ys[Lattice_Count], zs[Lattice_Count];
+        f32 results[Noise_Type_Count][Lattice_Count];
+
+        println ("  3D density params (%d octaves), %d sections:", Default_Density_Perlin_Params.octaves, grid_count);
+
+        for_range (level, 0, supported_level + 1)
+        {
+            g_perlin_simd_level = cast (Perlin_Simd_Level) level;
+
+            s64 times[Noise_Type_Count];
+            f64 max_error[Noise_Type_Count] = {};
+            for_range (type, 0, Noise_Type_Count)
+            {
+                auto params = Default_Density_Perlin_Params;
+                params.noise_type = cast (Noise_Type) type;
+
+                s64 start = time_current_monotonic ();
+                for_range (g, 0, grid_count)
+                {
+                    for_range (j, 0, Lattice_Count)
+                    {
+                        xs[j] = cast (f32) ((j / (Lattice_Width * Lattice_Height)) * Density_Cell_Size);
+                        ys[j] = cast (f32) ((g % 24) * Chunk_Section_Height + (j % Lattice_Height) * Density_Cell_Height);
+                        zs[j] = cast (f32) ((g / 24) * Chunk_Size + ((j / Lattice_Height) % Lattice_Width) * Density_Cell_Size);
+                    }
+
+                    perlin_fractal_noise_batch (params, offsets_3d, permutations, Lattice_Count, xs, ys, zs, results[type]);
+                }
+                times[type] = time_current_monotonic () - start;
+
+                // Compare the last section against the scalar functions
+                for_range (j, 0, Lattice_Count)
+                {
+                    f64 expected = perlin_fractal_noise (params, offsets_3d, permutations, xs[j], ys[j], zs[j]);
+                    max_error[type] = max (max_error[type], fabs (results[type][j] - expected));
+                }
+            }
+
+            println ("    %-6s Perlin %.3f us/section (max error %g), Simplex %.3f us/section (max error %g, x%.2f)",
+                perlin_simd_level_name (g_perlin_simd_level),
+                times[Noise_Type_Perlin] / cast (f64) grid_count, max_error[Noise_Type_Perlin],
+                times[Noise_Type_Simplex] / cast (f64) grid_count, max_error[Noise_Type_Simplex],
+                times[Noise_Type_Perlin] / cast (f64) max (times[Noise_Type_Simplex], cast (s64) 1));
+        }
+    }
+}
@@ -93,14 +93,110 @@ void main ()
 }
 )""";
 
-bool render_init (const char *textures_dirname)
+const char *GL_Bounding_Box_Shader_Vertex = R"""(
+#version 330 core
+
+layout (location = 0) in vec3 a_Position;
+
+uniform mat4 u_View_Projection_Matrix;
+uniform vec3 u_Box_Min;
+uniform vec3 u_Box_Size;
+
+void main ()
 {
-    if (!load_texture_atlas (textures_dirname))
-    {
-        println ("Error: could not load textures");
-        return false;
-    }
+    gl_Position = u_View_Projection_Matrix * vec4 (u_Box_Min + a_Position * u_Box_Size, 1);
+}
+)""";
+
+const char *GL_Bounding_Box_Shader_Fragment = R"""(
+#version 330 core
+
+out vec4 Frag_Color;
+
+void main ()
+{
+    Frag_Color = vec4 (1);
+}
+)""";
+
+const char *GL_Far_Terrain_Shader_Vertex = R"""(
+layout (location = 0) in vec3 a_Position;
+layout (location = 1) in vec3 a_Normal;
+layout (location = 2) in int a_Block_Id;
+
+out vec3 World_Position;
+out vec3 Normal;
+out vec2 Tex_Coords;
+
+uniform mat4 u_View_Projection_Matrix;
+uniform sampler2D u_Texture_Atlas;
+
+void main ()
+{
+    gl_Position = u_View_Projection_Matrix * vec4 (a_Position, 1);
+    World_Position = a_Position;
+    Normal = a_Normal;
+
+    // Far terrain only uses the average color of the block texture,
+    // so we sample the center of the cell at the smallest mip level
+    int atlas_cell_x = a_Block_Id % Atlas_Cell_Count;
+    int atlas_cell_y = a_Block_Id / Atlas_Cell_Count;
+
+    ivec2 atlas_size = textureSize (u_Texture_Atlas, 0);
+    Tex_Coords.x = (float (atlas_cell_x) + 0.5) * Atlas_Cell_Size / float (atlas_size.x);
+    Tex_Coords.y = (float (atlas_cell_y) + 0.5) * Atlas_Cell_Size / float (atlas_size.y);
+}
+)""";
+
+const char *GL_Far_Terrain_Shader_Fragment = R"""(
+in vec3 World_Position;
+in vec3 Normal;
+in vec2 Tex_Coords;
 
+out vec4 Frag_Color;
+
+uniform sampler2D u_Texture_Atlas;
+uniform vec3 u_Camera_Position;
+uniform float u_Inner_Radius;
+uniform float u_Fog_Distance;
+
+const vec3 Sky_Color = vec3 (0.2, 0.3, 0.6);
+
+void main ()
+{
+    // The area around the camera is covered by the chunk meshes
+    float dist = distance (World_Position.xz, u_Camera_Position.xz);
+    if (dist < u_Inner_Radius)
+        discard;
+
+    vec3 light_direction = normalize (vec3 (0.5, 1, 0.2));
+    vec4 sampled = textureLod (u_Texture_Atlas, Tex_Coords, float (Atlas_Cell_Border_Size - 1));
+    vec3 color = sampled.rgb * max (dot (normalize (Normal), light_direction), 0.25);
+
+    float fog = clamp (dist / u_Fog_Distance, 0.0, 1.0);
+    Frag_Color = vec4 (mix (color, Sky_Color, fog * fog), 1);
+}
+)""";
+
+GLuint g_far_terrain_shader;
+
+GLuint g_bounding_box_shader;
+GLuint g_bounding_box_vao;
+GLuint g_bounding_box_vbo;
+
+// Unit cube, the winding order does not matter since
+// bounding boxes are drawn with face culling disabled
+static const f32 Unit_Cube_Vertices[] = {
+    0,0,0, 1,0,0, 1,1,0,  0,0,0, 1,1,0, 0,1,0,
+    0,0,1, 1,1,1, 1,0,1,  0,0,1, 0,1,1, 1,1,1,
+    0,0,0, 0,1,1, 0,0,1,  0,0,0, 0,1,0, 0,1,1,
+    1,0,0, 1,0,1, 1,1,1,  1,0,0, 1,1,1, 1,1,0,
+    0,0,0, 0,0,1, 1,0,1,  0,0,0, 1,0,1, 1,0,0,
+    0,1,0, 1,1,1, 0,1,1,  0,1,0, 1,1,0, 1,1,1,
+};
+
+GLuint create_shader_program (const char *vertex_shader_source, const char *fragment_shader_source)
+{
     GLuint vertex_shader = glCreateShader (GL_VERTEX_SHADER);
     defer (glDeleteShader (vertex_shader));
 
@@ -110,10 +206,6 @@ bool render_init (const char *textures_dirname)
     int status;
     char info_log[4096];
 
-    const char *shader_header = fcstring (frame_allocator, GL_Block_Shader_Header, Atlas_Cell_Size_No_Border, Atlas_Cell_Border_Size, g_atlas_cell_count);
-    const char *vertex_shader_source = fcstring (frame_allocator, "%s\n%s", shader_header, GL_Block_Shader_Vertex);
-    const char *fragment_shader_source = fcstring (frame_allocator, "%s\n%s", shader_header, GL_Block_Shader_Fragment);
-
     glShaderSource (vertex_shader, 1, &vertex_shader_source, null);
     glCompileShader (vertex_shader);
     glGetShaderiv (vertex_shader, GL_COMPILE_STATUS, &status);
@@ -122,7 +214,7 @@ bool render_init (const char *textures_dirname)
         glGetShaderInfoLog (vertex_shader, sizeof (info_log), null, info_log);
         println ("GL Error: could not compile vertex shader.\n%s", info_log);
 
-        return false;
+        return 0;
     }
 
     glShaderSource (fragment_shader, 1, &fragment_shader_source, null);
@@ -133,22 +225,66 @@ bool render_init (const char *textures_dirname)
         glGetShaderInfoLog (fragment_shader, sizeof (info_log), null, info_log);
         println ("GL Error: could not compile fragment shader.\n%s", info_log);
 
-        return false;
+        return 0;
     }
 
-    g_block_shader = glCreateProgram ();
-    glAttachShader (g_block_shader, vertex_shader);
-    glAttachShader (g_block_shader, fragment_shader);
-    glLinkProgram (g_block_shader);
-    glGetProgramiv (g_block_shader, GL_LINK_STATUS, &status);
+    GLuint program = glCreateProgram ();
+    glAttachShader (program, vertex_shader);
+    glAttachShader (program, fragment_shader);
+    glLinkProgram (program);
+    glGetProgramiv (program, GL_LINK_STATUS, &status);
     if (!status)
     {
-        glGetProgramInfoLog (g_block_shader, sizeof (info_log), null, info_log);
+        glGetProgramInfoLog (program, sizeof (info_log), null, info_log);
         println ("GL Error: could not link shader program.\n%s", info_log);
+        glDeleteProgram (program);
 
+        return 0;
+    }
+
+    return program;
+}
+
+bool render_init (const char *textures_dirname)
+{
+    if (!load_texture_atlas (textures_dirname))
+    {
+        println ("Error: could not load textures");
         return false;
     }
 
+    const char *shader_header = fcstring (frame_allocator, GL_Block_Shader_Header, Atlas_Cell_Size_No_Border, Atlas_Cell_Border_Size, g_atlas_cell_count);
+    const char *vertex_shader_source = fcstring (frame_allocator, "%s\n%s", shader_header, GL_Block_Shader_Vertex);
+    const char *fragment_shader_source = fcstring (frame_allocator, "%s\n%s", shader_header, GL_Block_Shader_Fragment);
+
+    g_block_shader = create_shader_program (vertex_shader_source, fragment_shader_source);
+    if (!g_block_shader)
+        return false;
+
+    vertex_shader_source = fcstring (frame_allocator, "%s\n%s", shader_header, GL_Far_Terrain_Shader_Vertex);
+    fragment_shader_source = fcstring (frame_allocator, "%s\n%s", shader_header, GL_Far_Terrain_Shader_Fragment);
+
+    g_far_terrain_shader = create_shader_program (vertex_shader_source, fragment_shader_source);
+    if (!g_far_terrain_shader)
+        return false;
+
+    g_bounding_box_shader = create_shader_program (GL_Bounding_Box_Shader_Vertex, GL_Bounding_Box_Shader_Fragment);
+    if (!g_bounding_box_shader)
+        return false;
+
+    glGenVertexArrays (1, &g_bounding_box_vao);
+    glGenBuffers (1, &g_bounding_box_vbo);
+
+    glBindVertexArray (g_bounding_box_vao);
+    glBindBuffer (GL_ARRAY_BUFFER, g_bounding_box_vbo);
+    glBufferData (GL_ARRAY_BUFFER, sizeof (Unit_Cube_Vertices), Unit_Cube_Vertices, GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray (0);
+    glVertexAttribPointer (0, 3, GL_FLOAT, GL_FALSE, sizeof (f32) * 3, cast (void *) 0);
+
+    glBindVertexArray (0);
+    glBindBuffer (GL_ARRAY_BUFFER, 0);
+
     return true;
 }
 
@@ -267,10 +403,10 @@ bool load_texture_atlas (const char *textures_dirname)
         "stone.png",
         "bedrock.png",
         "water.png",
-        "five.png",
-        "six.png",
-        "seven.png",
-        "eight.png",
+        "log.png",
+        "leaves.png",
+        "coal_ore.png",
+        "iron_ore.png",
     };
 
     static const int Texture_Count = array_size (Texture_Names);
@@ -340,21 +476,233 @@ void chunk_draw (Chunk *chunk, Camera *camera, Chunk_Mesh_Type mesh_type)
     if (chunk->vertex_counts[mesh_type] == 0)
         return;
 
+    // If the result of the last query has not come back to us yet, let
+    // the GPU discard the draw call itself if it knows the chunk is hidden
+    bool conditional = g_occlusion_culling && chunk->occlusion_query_pending;
+    if (conditional)
+        glBeginConditionalRender (chunk->gl_occlusion_query, GL_QUERY_NO_WAIT);
+
     glBindVertexArray (chunk->opengl_is_stupid_vaos[mesh_type]);
     glBindBuffer (GL_ARRAY_BUFFER, chunk->gl_vbos[mesh_type]);
 
-    glDrawArrays (GL_TRIANGLES, 0, chunk->vertex_counts[mesh_type]);
+    if (mesh_type == Chunk_Mesh_Water && chunk->water_sort_valid)
+        glDrawElements (GL_TRIANGLES, chunk->vertex_counts[mesh_type], GL_UNSIGNED_INT, null);
+    else
+        glDrawArrays (GL_TRIANGLES, 0, chunk->vertex_counts[mesh_type]);
 
     glBindBuffer (GL_ARRAY_BUFFER, 0);
     glBindVertexArray (0);
+
+    if (conditional)
+        glEndConditionalRender ();
+
+    g_drawn_vertex_count += chunk->vertex_counts[mesh_type];
+}
+
+void chunk_update_occlusion (Chunk *chunk)
+{
+    if (!g_occlusion_culling)
+    {
+        chunk->occluded = false;
+        return;
+    }
+
+    if (!chunk->occlusion_query_pending)
+        return;
+
+    // Never wait on the GPU, we'll use the result whenever it is ready
+    GLuint available = 0;
+    glGetQueryObjectuiv (chunk->gl_occlusion_query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return;
+
+    GLuint any_samples_passed = 0;
+    glGetQueryObjectuiv (chunk->gl_occlusion_query, GL_QUERY_RESULT, &any_samples_passed);
+    chunk->occluded = !any_samples_passed;
+    chunk->occlusion_query_pending = false;
+}
+
+struct Water_Face_Sort_Entry
+{
+    f32 sqrd_distance;
+    u32 face_index;
+};
+
+int compare_water_faces_back_to_front (const Water_Face_Sort_Entry &a, const Water_Face_Sort_Entry &b)
+{
+    if (a.sqrd_distance > b.sqrd_distance)
+        return -1;
+    if (a.sqrd_distance < b.sqrd_distance)
+        return 1;
+
+    return 0;
+}
+
+void chunk_sort_water_faces (Chunk *chunk, Camera *camera)
+{
+    if (chunk->water_face_centers.count == 0)
+        return;
+
+    Vec3l camera_cell = {
+        cast (s64) floorf (camera->position.x / Chunk_Size),
+        cast (s64) floorf (camera->position.y / Chunk_Size),
+        cast (s64) floorf (camera->position.z / Chunk_Size),
+    };
+
+    // The order of the faces only changes significantly when the camera crosses a cell boundary
+    if (chunk->water_sort_valid && chunk->water_sort_camera_cell == camera_cell)
+        return;
+
+    auto state = arena_get_state (&frame_arena);
+    defer (arena_set_state (&frame_arena, state));
+
+    s64 face_count = chunk->water_face_centers.count;
+    auto entries = slice_alloc<Water_Face_Sort_Entry> (face_count, frame_allocator);
+    for_range (i, 0, face_count)
+    {
+        entries[i].sqrd_distance = sqrd_distance (chunk->water_face_centers[i], camera->position);
+        entries[i].face_index = cast (u32) i;
+    }
+
+    sort (entries, compare_water_faces_back_to_front);
+
+    u32 *indices = mem_alloc_uninit (u32, face_count * 6, frame_allocator);
+    for_range (i, 0, face_count)
+    {
+        for_range (k, 0, 6)
+            indices[i * 6 + k] = entries[i].face_index * 6 + cast (u32) k;
+    }
+
+    // The element buffer binding is part of the vertex array state
+    glBindVertexArray (chunk->opengl_is_stupid_vaos[Chunk_Mesh_Water]);
+    glBufferData (GL_ELEMENT_ARRAY_BUFFER, sizeof (u32) * face_count * 6, indices, GL_DYNAMIC_DRAW);
+    glBindVertexArray (0);
+
+    chunk->water_sort_camera_cell = camera_cell;
+    chunk->water_sort_valid = true;
+}
+
+struct Chunk_Sort_Entry
+{
+    f32 sqrd_distance;
+    Chunk *chunk;
+};
+
+int compare_chunks_front_to_back (const Chunk_Sort_Entry &a, const Chunk_Sort_Entry &b)
+{
+    if (a.sqrd_distance < b.sqrd_distance)
+        return -1;
+    if (a.sqrd_distance > b.sqrd_distance)
+        return 1;
+
+    return 0;
+}
+
+static const f32 Occlusion_Box_Margin = 0.05;
+
+// Returns true if the occlusion box of the chunk contains the camera or is close enough to
+// cross the near plane. The box is then clipped, so the query would report the chunk as
+// hidden even though it is right in front of the camera.
+bool chunk_occlusion_box_is_near_camera (Chunk *chunk, Camera *camera)
+{
+    // Block vertices are offset by half a block from the block position
+    Vec3f box_min = {
+        chunk->x * Chunk_Size - 0.5f - Occlusion_Box_Margin,
+        chunk->mesh_y_range.x - Occlusion_Box_Margin,
+        chunk->z * Chunk_Size - 0.5f - Occlusion_Box_Margin,
+    };
+    Vec3f box_max = {
+        (chunk->x + 1) * Chunk_Size - 0.5f + Occlusion_Box_Margin,
+        chunk->mesh_y_range.y + Occlusion_Box_Margin,
+        (chunk->z + 1) * Chunk_Size - 0.5f + Occlusion_Box_Margin,
+    };
+
+    Vec3f closest = {
+        clamp (camera->position.x, box_min.x, box_max.x),
+        clamp (camera->position.y, box_min.y, box_max.y),
+        clamp (camera->position.z, box_min.z, box_max.z),
+    };
+
+    // Distance from the camera to the corners of the near plane
+    f32 tan_half_fov = tanf (to_rads (camera->fov) * 0.5f);
+    f32 near_reach = Camera_Near_Plane * sqrtf (1 + tan_half_fov * tan_half_fov * (1 + camera->aspect_ratio * camera->aspect_ratio));
+
+    return sqrd_distance (closest, camera->position) <= near_reach * near_reach;
+}
+
+// Draws the bounding boxes of the chunks against the depth buffer of the
+// opaque pass. The results are read back in the next frames by chunk_update_occlusion
+void issue_occlusion_queries (Slice<Chunk *> chunks, Camera *camera)
+{
+    glUseProgram (g_bounding_box_shader);
+
+    auto loc = glGetUniformLocation (g_bounding_box_shader, "u_View_Projection_Matrix");
+    glUniformMatrix4fv (loc, 1, GL_TRUE, camera->view_projection_matrix.comps);
+
+    auto box_min_loc = glGetUniformLocation (g_bounding_box_shader, "u_Box_Min");
+    auto box_size_loc = glGetUniformLocation (g_bounding_box_shader, "u_Box_Size");
+
+    glColorMask (GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask (GL_FALSE);
+    glDisable (GL_CULL_FACE);
+
+    glBindVertexArray (g_bounding_box_vao);
+
+    for_array (i, chunks)
+    {
+        auto chunk = chunks[i];
+        if (chunk->occlusion_query_pending || chunk->total_vertex_count == 0)
+            continue;
+
+        if (chunk_occlusion_box_is_near_camera (chunk, camera))
+            continue;
+
+        // Block vertices are offset by half a block from the block position
+        Vec3f box_min = {
+            chunk->x * Chunk_Size - 0.5f - Occlusion_Box_Margin,
+            chunk->mesh_y_range.x - Occlusion_Box_Margin,
+            chunk->z * Chunk_Size - 0.5f - Occlusion_Box_Margin,
+        };
+        Vec3f box_size = {
+            Chunk_Size + Occlusion_Box_Margin * 2,
+            chunk->mesh_y_range.y - chunk->mesh_y_range.x + Occlusion_Box_Margin * 2,
+            Chunk_Size + Occlusion_Box_Margin * 2,
+        };
+
+        glUniform3f (box_min_loc, box_min.x, box_min.y, box_min.z);
+        glUniform3f (box_size_loc, box_size.x, box_size.y, box_size.z);
+
+        glBeginQuery (GL_ANY_SAMPLES_PASSED, chunk->gl_occlusion_query);
+        glDrawArrays (GL_TRIANGLES, 0, array_size (Unit_Cube_Vertices) / 3);
+        glEndQuery (GL_ANY_SAMPLES_PASSED);
+
+        chunk->occlusion_query_pending = true;
+    }
+
+    glBindVertexArray (0);
+
+    glEnable (GL_CULL_FACE);
+    glDepthMask (GL_TRUE);
+    glColorMask (GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 }
 
 void world_draw_chunks (World *world, Camera *camera)
 {
-    Array<Chunk *> chunks_to_draw;
-    array_init (&chunks_to_draw, frame_allocator);
+    s64 draw_start = time_current_monotonic ();
+
+    Array<Chunk_Sort_Entry> sorted_chunks;
+    array_init (&sorted_chunks, frame_allocator);
 
     g_drawn_vertex_count = 0;
+    g_frame_meshing_time = 0;
+    g_frame_meshed_chunk_count = 0;
+
+    int meshed_chunk_count = 0;
+
+    if (g_far_terrain_enabled)
+        far_terrain_draw (world, camera);
+
+    g_occluded_chunk_count = 0;
     for_hash_map (it, world->all_loaded_chunks)
     {
         auto chunk = *it.value;
@@ -362,14 +710,85 @@ void world_draw_chunks (World *world, Camera *camera)
         Vec2f camera_planar_pos = {camera->position.x, camera->position.z};
         Vec2f world_chunk_pos = {cast (f32) chunk->x * Chunk_Size, cast (f32) chunk->z * Chunk_Size};
 
-        if (distance (world_chunk_pos, camera_planar_pos) < cast (f64) g_render_distance * Chunk_Size)
+        f32 chunk_distance = distance (world_chunk_pos, camera_planar_pos);
+        if (chunk_distance < cast (f64) g_render_distance * Chunk_Size)
         {
-            chunk_generate_mesh_data (chunk);
-            array_push (&chunks_to_draw, chunk);
-            g_drawn_vertex_count += chunk->total_vertex_count;
+            int lod = chunk_lod_for_distance (chunk_distance / Chunk_Size);
+            if (lod != chunk->mesh_lod)
+            {
+                chunk->mesh_lod = lod;
+                chunk->is_dirty = true;
+
+                // Neighbours may need to add or remove their skirts
+                if (chunk->east)
+                    chunk->east->is_dirty = true;
+                if (chunk->west)
+                    chunk->west->is_dirty = true;
+                if (chunk->north)
+                    chunk->north->is_dirty = true;
+                if (chunk->south)
+                    chunk->south->is_dirty = true;
+            }
+
+            // Dirty chunks over the budget keep their previous mesh until a later frame.
+            // Chunks are meshed once they and their neighbours have reached the light stage
+            bool can_mesh = chunk->stage >= Chunk_Stage_Light && chunk_neighbours_reached_stage (chunk, Chunk_Stage_Light);
+            if (chunk->is_dirty && can_mesh && (g_chunk_meshing_budget <= 0 || meshed_chunk_count < g_chunk_meshing_budget))
+            {
+                s64 time_start = time_current_monotonic ();
+
+                chunk_generate_mesh_data (chunk);
+                chunk->stage = Chunk_Stage_Mesh;
+
+                s64 elapsed = time_current_monotonic () - time_start;
+                g_frame_meshing_time += elapsed;
+                g_chunk_meshing_time += elapsed;
+                g_chunk_meshing_samples += 1;
+                meshed_chunk_count += 1;
+                g_frame_meshed_chunk_count += 1;
+            }
+            else if (chunk->dirty_sections && chunk->stage == Chunk_Stage_Mesh && can_mesh)
+            {
+                // Block edits only mesh the sections they touched again, which is cheap
+                // enough to not count against the meshing budget
+                s64 time_start = time_current_monotonic ();
+
+                chunk_generate_section_meshes (chunk);
+
+                s64 elapsed = time_current_monotonic () - time_start;
+                g_frame_meshing_time += elapsed;
+                g_section_meshing_time += elapsed;
+                g_section_meshing_samples += 1;
+            }
+
+            if (chunk->stage < Chunk_Stage_Mesh)
+                continue;
+
+            chunk_update_occlusion (chunk);
+            if (chunk_occlusion_box_is_near_camera (chunk, camera))
+                chunk->occluded = false;
+
+            Vec3f chunk_center = {
+                (chunk->x + 0.5f) * Chunk_Size,
+                (chunk->mesh_y_range.x + chunk->mesh_y_range.y) * 0.5f,
+                (chunk->z + 0.5f) * Chunk_Size,
+            };
+            array_push (&sorted_chunks, {sqrd_distance (chunk_center, camera->position), chunk});
+
+            if (chunk->occluded)
+                g_occluded_chunk_count += 1;
         }
     }
 
+    // Opaque geometry is drawn front to back to make the most of early depth
+    // testing, and water is drawn back to front for blending to be correct
+    sort (sorted_chunks, compare_chunks_front_to_back);
+
+    Array<Chunk *> chunks_to_draw;
+    array_init (&chunks_to_draw, frame_allocator, sorted_chunks.count);
+    for_array (i, sorted_chunks)
+        array_push (&chunks_to_draw, sorted_chunks[i].chunk);
+
     glEnable (GL_BLEND);
     glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
@@ -384,9 +803,29 @@ void world_draw_chunks (World *world, Camera *camera)
     loc = glGetUniformLocation (g_block_shader, "u_Texture_Atlas");
     glUniform1i (loc, 0);
 
-    for_range (mesh_type, 0, Chunk_Mesh_Count)
+    for_array (i, chunks_to_draw)
+    {
+        if (!chunks_to_draw[i]->occluded)
+            chunk_draw (chunks_to_draw[i], camera, Chunk_Mesh_Solid);
+    }
+
+    // The occlusion queries are tested against the depth buffer of the opaque geometry only
+    if (g_occlusion_culling)
     {
-        for_array (i, chunks_to_draw)
-            chunk_draw (chunks_to_draw[i], &g_camera, cast (Chunk_Mesh_Type) mesh_type);
+        issue_occlusion_queries (chunks_to_draw, camera);
+        glUseProgram (g_block_shader);
     }
+
+    for (s64 i = chunks_to_draw.count - 1; i >= 0; i -= 1)
+    {
+        auto chunk = chunks_to_draw[i];
+        if (chunk->occluded || chunk->vertex_counts[Chunk_Mesh_Water] == 0)
+            continue;
+
+        chunk_sort_water_faces (chunk, camera);
+        chunk_draw (chunk, camera, Chunk_Mesh_Water);
+    }
+
+    // This only measures the CPU side of drawing, the GPU work shows up in the frame time
+    g_frame_draw_time = time_current_monotonic () - draw_start - g_frame_meshing_time;
 }
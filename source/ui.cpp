@@ -7,78 +7,119 @@ static bool g_show_texture_atlas_window;
 static bool g_show_world_window;
 static bool g_show_terrain_noise_maps_window;
 
-void generate_terrain_value_texture (GLuint *tex, int x, int z, int size, Terrain_Value terrain_value)
+// The terrain noise maps read their values from the terrain cache. They are limited to a size
+// whose regions take at most a quarter of the cache, so that they do not evict the regions used
+// by chunk generation, and the missing regions are generated a few per frame.
+static const int Terrain_Noise_Map_Max_Size = 32;   // In chunks
+static const int Terrain_Noise_Map_Regions_Per_Frame = 2;
+
+static_assert (
+    (Terrain_Noise_Map_Max_Size / Terrain_Region_Size + 1) * (Terrain_Noise_Map_Max_Size / Terrain_Region_Size + 1) <= Terrain_Cache_Max_Regions / 4,
+    "The regions of the terrain noise maps must fit in a quarter of the terrain cache"
+);
+
+// Generates up to Terrain_Noise_Map_Regions_Per_Frame of the regions covering the size * size
+// chunks centered on chunk (x, z) that are not in the cache yet. Returns true once all are cached.
+bool terrain_noise_map_regions_ready (int x, int z, int size)
+{
+    s64 start_x = cast (s64) (x - size / 2) * Chunk_Size;
+    s64 start_z = cast (s64) (z - size / 2) * Chunk_Size;
+    s64 end_x = start_x + size * Chunk_Size;
+    s64 end_z = start_z + size * Chunk_Size;
+
+    int generated_count = 0;
+    for_range (region_x, terrain_region_coordinate (start_x, Terrain_Region_Width), terrain_region_coordinate (end_x - 1, Terrain_Region_Width) + 1)
+    {
+        for_range (region_z, terrain_region_coordinate (start_z, Terrain_Region_Width), terrain_region_coordinate (end_z - 1, Terrain_Region_Width) + 1)
+        {
+            if (terrain_cache_find_region (&g_world.terrain_cache, region_x, region_z))
+                continue;
+
+            if (generated_count >= Terrain_Noise_Map_Regions_Per_Frame)
+                return false;
+
+            terrain_cache_get_region (&g_world, region_x, region_z);
+            generated_count += 1;
+        }
+    }
+
+    return true;
+}
+
+// Generates one texture per Terrain_Value for the size * size chunks centered on chunk (x, z).
+// The values are read from the terrain cache, so the chunks do not need to be loaded, and each
+// region is requested once for all the textures.
+void generate_terrain_value_textures (GLuint textures[Terrain_Value_Count], int x, int z, int size)
 {
     static const ImVec4 Block_Color_Water = {0.2, 0.3, 0.6, 1.0};
-    static const ImVec4 Block_Color_Dirt = {0.4, 0.4, 0.2, 1.0};
 
     int texture_size = size * Chunk_Size;
-    u32 *texture_buffer = mem_alloc_uninit (u32, texture_size * texture_size, frame_allocator);
+    u32 *texture_buffers[Terrain_Value_Count];
+    for_range (i, 0, Terrain_Value_Count)
+        texture_buffers[i] = mem_alloc_uninit (u32, texture_size * texture_size, frame_allocator);
+
+    s64 start_x = cast (s64) (x - size / 2) * Chunk_Size;
+    s64 start_z = cast (s64) (z - size / 2) * Chunk_Size;
+    s64 end_x = start_x + texture_size;
+    s64 end_z = start_z + texture_size;
+
+    s64 first_region_x = terrain_region_coordinate (start_x, Terrain_Region_Width);
+    s64 first_region_z = terrain_region_coordinate (start_z, Terrain_Region_Width);
+    s64 last_region_x = terrain_region_coordinate (end_x - 1, Terrain_Region_Width);
+    s64 last_region_z = terrain_region_coordinate (end_z - 1, Terrain_Region_Width);
 
-    for_range (i, 0, size)
+    for_range (region_x, first_region_x, last_region_x + 1)
     {
-        for_range (j, 0, size)
+        for_range (region_z, first_region_z, last_region_z + 1)
         {
-            s64 tex_x = i * Chunk_Size;
-            s64 tex_y = (size - j - 1) * Chunk_Size;
+            auto region = terrain_cache_get_region (&g_world, region_x, region_z);
 
-            auto chunk = world_get_chunk (&g_world, x + i - size / 2, z + j - size / 2);
-            if (!chunk)
-            {
-                for_range (cx, 0, Chunk_Size)
-                {
-                    for_range (cz, 0, Chunk_Size)
-                    {
-                        texture_buffer[(tex_y + cz) * texture_size + tex_x + cx] = 0;
-                    }
-                }
-
-                continue;
-            }
+            s64 region_start_x = region_x * Terrain_Region_Width;
+            s64 region_start_z = region_z * Terrain_Region_Width;
 
-            for_range (cx, 0, Chunk_Size)
+            for_range (world_x, max (start_x, region_start_x), min (end_x, region_start_x + Terrain_Region_Width))
             {
-                for_range (cz, 0, Chunk_Size)
+                for_range (world_z, max (start_z, region_start_z), min (end_z, region_start_z + Terrain_Region_Width))
                 {
-                    if (terrain_value == Terrain_Value_Surface)
-                    {
-                        ImVec4 color = Block_Color_Water;
-                        f32 val = chunk->terrain_values[cx * Chunk_Size + cz].surface_level;
-                        f32 normalized_val = val / cast (f32) Chunk_Height;
+                    auto values = &region->values[(world_x - region_start_x) * Terrain_Region_Width + world_z - region_start_z];
 
-                        if (val > g_world.terrain_params.water_level)
-                        {
-                            color = ImVec4{normalized_val,normalized_val,normalized_val,1};
-                        }
+                    // Positive z goes up in the textures
+                    s64 pixel = (texture_size - 1 - (world_z - start_z)) * texture_size + world_x - start_x;
 
-                        texture_buffer[(tex_y + Chunk_Size - cz - 1) * texture_size + tex_x + cx] = ImGui::ColorConvertFloat4ToU32 (color);
-                    }
-                    else
+                    for_range (i, 0, Terrain_Value_Surface)
                     {
-                        f32 val = chunk->terrain_values[cx * Chunk_Size + cz].noise[terrain_value];
-
-                        u8 color_comp = cast (u8) (val * 255);
-                        texture_buffer[(tex_y + Chunk_Size - cz - 1) * texture_size + tex_x + cx] = (0xff << 24) | (color_comp << 16) | (color_comp << 8) | (color_comp << 0);
+                        u8 color_comp = cast (u8) (values->noise[i] * 255);
+                        texture_buffers[i][pixel] = (0xff << 24) | (color_comp << 16) | (color_comp << 8) | (color_comp << 0);
                     }
 
+                    ImVec4 color = Block_Color_Water;
+                    f32 normalized_val = values->surface_level / cast (f32) Chunk_Height;
+                    if (values->surface_level > g_world.terrain_params.water_level)
+                        color = ImVec4{normalized_val,normalized_val,normalized_val,1};
+
+                    texture_buffers[Terrain_Value_Surface][pixel] = ImGui::ColorConvertFloat4ToU32 (color);
                 }
             }
         }
     }
 
-    if (!*tex)
-        glGenTextures (1, tex);
+    for_range (i, 0, Terrain_Value_Count)
+    {
+        if (!textures[i])
+            glGenTextures (1, &textures[i]);
+
+        glBindTexture (GL_TEXTURE_2D, textures[i]);
+        glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA, texture_size, texture_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, texture_buffers[i]);
+    }
 
-    glBindTexture (GL_TEXTURE_2D, *tex);
-    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA, texture_size, texture_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, texture_buffer);
     glBindTexture (GL_TEXTURE_2D, 0);
 }
 
 void generate_noise_texture (GLuint *tex,
     int width, int height, f64 offset_x, f64 offset_y,
-    int seed, f64 scale, int octaves, f64 persistance, f64 lacunarity,
+    int seed, f64 scale, int octaves, f64 persistance, f64 lacunarity, Noise_Type noise_type,
     f32 *out_min = null, f32 *out_max = null)
 {
     Vec2f offsets[Perlin_Fractal_Max_Octaves];
@@ -103,7 +144,7 @@ void generate_noise_texture (GLuint *tex,
     {
         for_range (y, 0, height)
         {
-            auto val = perlin_fractal_noise (scale, octaves, offsets, persistance, lacunarity, x + offset_x, y + offset_y);
+            auto val = perlin_fractal_noise (scale, octaves, offsets, null, persistance, lacunarity, x + offset_x, y + offset_y, noise_type);
             if (val < min_non_normalized)
                 min_non_normalized = val;
             if (val > max_non_normalized)
@@ -135,6 +176,12 @@ bool ui_show_perlin_fractal_params (ImGuiID id, Perlin_Fractal_Params *params)
     ImGui::PushID (id);
 
     bool result = false;
+    int noise_type = cast (int) params->noise_type;
+    if (ImGui::Combo ("Type", &noise_type, Noise_Type_Names, array_size (Noise_Type_Names)))
+    {
+        params->noise_type = cast (Noise_Type) noise_type;
+        result = true;
+    }
     if (ImGui::SliderFloat ("Scale", &params->scale, 0.001, 0.2, "%.6f"))
         result = true;
     if (ImGui::SliderInt ("Octaves", &params->octaves, 1, Perlin_Fractal_Max_Octaves))
@@ -155,14 +202,14 @@ void ui_show_perlin_test_window (bool *opened)
     static int texture_size = 256;
     static int seed;
     static f32 offset_x, offset_y;
-    static Perlin_Fractal_Params params = {0.05, 3, 0.5, 1.5};
+    static Perlin_Fractal_Params params = {0.05, 3, 0.5, 1.5, Noise_Type_Perlin};
     static f32 min_value = F32_MAX;
     static f32 max_value = -F32_MAX;
 
     if (ImGui::Begin ("Perlin Test", opened))
     {
         {
-            int lines = 7;
+            int lines = 8;
             auto child_height = ImGui::GetContentRegionAvail ().y - lines * ImGui::GetFrameHeightWithSpacing ();
             if (ImGui::BeginChild ("Image", {0, child_height}, true, ImGuiWindowFlags_HorizontalScrollbar))
             {
@@ -202,9 +249,26 @@ void ui_show_perlin_test_window (bool *opened)
             should_generate = true;
         }
 
+        {
+            const char *level_names[] = {
+                perlin_simd_level_name (Perlin_Simd_None),
+                perlin_simd_level_name (Perlin_Simd_SSE4),
+                perlin_simd_level_name (Perlin_Simd_AVX2),
+            };
+
+            int level = cast (int) g_perlin_simd_level;
+            if (ImGui::Combo ("Max SIMD level", &level, level_names, array_size (level_names)))
+                g_perlin_simd_level = cast (Perlin_Simd_Level) level;
+
+            ImGui::SameLine ();
+
+            if (ImGui::Button ("Benchmark"))
+                perlin_benchmark (10000);
+        }
+
         if (should_generate)
         {
-            generate_noise_texture (&texture_handle, texture_size, texture_size, offset_x, offset_y, seed, params.scale, params.octaves, params.persistance, params.lacunarity, &min_value, &max_value);
+            generate_noise_texture (&texture_handle, texture_size, texture_size, offset_x, offset_y, seed, params.scale, params.octaves, params.persistance, params.lacunarity, params.noise_type, &min_value, &max_value);
         }
 
     }
@@ -216,23 +280,69 @@ void ui_show_metrics_and_settings_window (bool *opened)
     if (ImGui::Begin ("Metrics and Settings", opened))
     {
         s64 total_vertex_count = 0;
+        s64 stage_counts[Chunk_Stage_Count] = {};
         for_hash_map (it, g_world.all_loaded_chunks)
         {
             auto chunk = *it.value;
             if (chunk)
+            {
                 total_vertex_count += chunk->total_vertex_count;
+                stage_counts[chunk->stage] += 1;
+            }
         }
 
         ImGui::LabelText ("Frame time", "%.2f ms, %.2f FPS", g_delta_time / 1000.0, 1000000.0 / g_delta_time);
         ImGui::LabelText ("Position", "%.2f %.2f %.2f", g_camera.position.x, g_camera.position.y, g_camera.position.z);
+        {
+            s64 x = cast (s64) floorf (g_camera.position.x);
+            s64 z = cast (s64) floorf (g_camera.position.z);
+            ImGui::LabelText ("Heights below", "surface %lld, solid %lld, ocean floor %lld",
+                world_get_height (&g_world, Heightmap_World_Surface, x, z),
+                world_get_height (&g_world, Heightmap_Solid_Surface, x, z),
+                world_get_height (&g_world, Heightmap_Ocean_Floor, x, z));
+        }
         ImGui::LabelText ("Average chunk creation   time", "%f us", g_chunk_creation_time / cast (f32) g_chunk_creation_samples);
         ImGui::LabelText ("Average chunk generation time", "%f us", g_chunk_generation_time / cast (f32) g_chunk_generation_samples);
         ImGui::LabelText ("Loaded chunks", "%lld", g_world.all_loaded_chunks.count);
+
+        static const char *Chunk_Stage_Names[Chunk_Stage_Count] = {
+            "Empty", "Terrain values", "Blocks", "Surface", "Features", "Light", "Mesh"
+        };
+
+        for_range (i, 0, Chunk_Stage_Count)
+        {
+            if (stage_counts[i] > 0)
+                ImGui::LabelText (Chunk_Stage_Names[i], "%lld chunks", stage_counts[i]);
+        }
+
         ImGui::LabelText ("Total vertex count", "%lld", total_vertex_count);
         ImGui::LabelText ("Drawn vertex count", "%lld", g_drawn_vertex_count);
+        ImGui::LabelText ("Occluded chunks", "%lld", g_occluded_chunk_count);
         ImGui::LabelText ("Average vertices per chunk", "%lld", total_vertex_count / g_world.all_loaded_chunks.count);
         ImGui::Checkbox ("Generate new chunks", &g_generate_new_chunks);
-        ImGui::SliderInt ("Render distance", &g_render_distance, 1, 12);
+        ImGui::SliderInt ("Render distance", &g_render_distance, 1, 32);
+        ImGui::Checkbox ("Adaptive render distance", &g_adaptive_render_distance);
+        if (g_adaptive_render_distance)
+        {
+            f32 target_ms = g_target_frame_time / 1000.0f;
+            if (ImGui::SliderFloat ("Target frame time", &target_ms, 4, 50, "%.1f ms"))
+                g_target_frame_time = cast (s64) (target_ms * 1000);
+
+            ImGui::DragIntRange2 ("Render distance range", &g_min_render_distance, &g_max_render_distance, 1, 1, 32);
+            ImGui::LabelText ("Frame work time", "%.2f ms", g_frame_work_time / 1000.0);
+            ImGui::LabelText ("Generation/meshing/draw", "%.2f / %.2f / %.2f ms", g_frame_generation_time / 1000.0, g_frame_meshing_time / 1000.0, g_frame_draw_time / 1000.0);
+            ImGui::LabelText ("Chunks this frame", "%d generated, %d meshed", g_frame_generated_chunk_count, g_frame_meshed_chunk_count);
+            ImGui::LabelText ("Chunk budgets", "%d generation, %d meshing", g_chunk_generation_budget, g_chunk_meshing_budget);
+            ImGui::LabelText ("Far terrain tiles", "%d this frame, budget %d", g_frame_far_terrain_tile_count, g_far_terrain_tiles_per_frame);
+        }
+        if (g_section_meshing_samples > 0)
+            ImGui::LabelText ("Section remeshing", "%.1f us average over %lld chunks", g_section_meshing_time / cast (f64) g_section_meshing_samples, g_section_meshing_samples);
+        ImGui::SliderInt ("LOD distance", &g_lod_distance, 1, 32);
+        ImGui::Checkbox ("Occlusion culling", &g_occlusion_culling);
+        if (ImGui::Checkbox ("Far terrain", &g_far_terrain_enabled) && !g_far_terrain_enabled)
+            far_terrain_clear (&g_world);   // Free the tiles, they are not updated while disabled
+        ImGui::SliderInt ("Far terrain distance", &g_far_terrain_distance, 16, Far_Terrain_Max_Distance);
+        ImGui::LabelText ("Far terrain tiles", "%lld", g_world.far_terrain_tiles.count);
     }
     ImGui::End ();
 }
@@ -291,77 +401,74 @@ void ui_show_basic_world_settings ()
 
 void ui_show_terrain_noise_maps (bool generate = false)
 {
-    static GLuint continentalness_tex;
-    static GLuint erosion_tex;
-    static GLuint weirdness_tex;
-    static GLuint ridges_tex;
-    static GLuint surface_tex;
+    static const char *Texture_Names[Terrain_Value_Count] = {
+        "Continentalness",
+        "Erosion",
+        "Weirdness",
+        "Ridges",
+        "Surface",
+    };
+
+    static GLuint textures[Terrain_Value_Count];
 
     static const f32 Scale = 1;
 
     static int size = 8;
+    static bool pending = false;
+    static int center_x, center_z;
 
-    int lines = 3;
+    int lines = 4;
     auto child_height = ImGui::GetContentRegionAvail ().y - lines * ImGui::GetFrameHeightWithSpacing ();
     if (ImGui::BeginChild ("Noise Maps", {0, child_height}, true, ImGuiWindowFlags_HorizontalScrollbar))
     {
         int column_count = clamp (cast (int) (ImGui::GetContentRegionAvail ().x / (size * Chunk_Size * Scale)), 1, 5);
         ImGui::Columns (column_count, 0, false);
 
-        ImGui::Text ("Continentalness");
-        ImGui::Image (cast (ImTextureID) continentalness_tex, {size * Chunk_Size * Scale, size * Chunk_Size * Scale});
-        ImGui::NextColumn ();
-
-        ImGui::Text ("Erosion");
-        ImGui::Image (cast (ImTextureID) erosion_tex, {size * Chunk_Size * Scale, size * Chunk_Size * Scale});
-        ImGui::NextColumn ();
-
-        ImGui::Text ("Weirdness");
-        ImGui::Image (cast (ImTextureID) weirdness_tex, {size * Chunk_Size * Scale, size * Chunk_Size * Scale});
-        ImGui::NextColumn ();
-
-        ImGui::Text ("Ridges");
-        ImGui::Image (cast (ImTextureID) ridges_tex, {size * Chunk_Size * Scale, size * Chunk_Size * Scale});
-        ImGui::NextColumn ();
-
-        ImGui::Text ("Surface");
-        ImGui::Image (cast (ImTextureID) surface_tex, {size * Chunk_Size * Scale, size * Chunk_Size * Scale});
-        ImGui::NextColumn ();
+        for_range (i, 0, Terrain_Value_Count)
+        {
+            ImGui::Text ("%s", Texture_Names[i]);
+            ImGui::Image (cast (ImTextureID) textures[i], {size * Chunk_Size * Scale, size * Chunk_Size * Scale});
+            ImGui::NextColumn ();
+        }
 
         ImGui::Columns ();
     }
     ImGui::EndChild ();
 
-    if (!continentalness_tex || !erosion_tex || !weirdness_tex || !ridges_tex || !surface_tex)
-        generate = true;
+    for_range (i, 0, Terrain_Value_Count)
+    {
+        if (!textures[i])
+            generate = true;
+    }
+
+    auto cache = &g_world.terrain_cache;
+    ImGui::Text ("Terrain cache: %lld/%d regions, %lld generated, %lld hits",
+        cache->regions.count, Terrain_Cache_Max_Regions, cache->generated_count, cache->hit_count);
 
-    if (ImGui::SliderInt ("Size", &size, 1, 100))
+    if (ImGui::SliderInt ("Size", &size, 1, Terrain_Noise_Map_Max_Size))
         generate = true;
 
     if (ImGui::Button ("Generate"))
         generate = true;
 
-    if (generate)
+    if (pending)
     {
-        generate_terrain_value_texture (&continentalness_tex,
-            cast (int) (g_camera.position.x / Chunk_Size), cast (int) (g_camera.position.z / Chunk_Size),
-            size, Terrain_Value_Continentalness);
-
-        generate_terrain_value_texture (&erosion_tex,
-            cast (int) (g_camera.position.x / Chunk_Size), cast (int) (g_camera.position.z / Chunk_Size),
-            size, Terrain_Value_Erosion);
-
-        generate_terrain_value_texture (&weirdness_tex,
-            cast (int) (g_camera.position.x / Chunk_Size), cast (int) (g_camera.position.z / Chunk_Size),
-            size, Terrain_Value_Weirdness);
+        ImGui::SameLine ();
+        ImGui::Text ("Generating regions...");
+    }
 
-        generate_terrain_value_texture (&ridges_tex,
-            cast (int) (g_camera.position.x / Chunk_Size), cast (int) (g_camera.position.z / Chunk_Size),
-            size, Terrain_Value_Ridges);
+    if (generate)
+    {
+        size = clamp (size, 1, Terrain_Noise_Map_Max_Size);
+        center_x = cast (int) (g_camera.position.x / Chunk_Size);
+        center_z = cast (int) (g_camera.position.z / Chunk_Size);
+        pending = true;
+    }
 
-        generate_terrain_value_texture (&surface_tex,
-            cast (int) (g_camera.position.x / Chunk_Size), cast (int) (g_camera.position.z / Chunk_Size),
-            size, Terrain_Value_Surface);
+    if (pending && terrain_noise_map_regions_ready (center_x, center_z, size))
+    {
+        generate_terrain_value_textures (textures, center_x, center_z, size);
+        pending = false;
     }
 }
 
@@ -543,6 +650,11 @@ void ui_show_cubiomes_viewer (bool *opened)
         if (ImGui::Button ("Generate"))
             generate = true;
 
+        ImGui::SameLine ();
+
+        if (ImGui::Button ("Benchmark Parallel Sampling"))
+            cubiome_benchmark (&g_world, 256);
+
         if (generate)
         {
             u32 *pixels = mem_alloc_uninit (u32, size * size, heap_allocator ());
@@ -667,6 +779,7 @@ void print_spline_init_code (String_Builder *builder, const Nested_Hermite_Splin
     }
 }
 
+// Returns true if the surface spline has been changed, and needs to be compiled again
 bool ui_surface_splines_editor (const char *str_id, Terrain_Params *params,
     ImVec2 *offset, float *scale, int *selected_spline, int *selected_knot,
     Slice<float> &t_values)
@@ -674,8 +787,11 @@ bool ui_surface_splines_editor (const char *str_id, Terrain_Params *params,
     ImGuiExt::HermiteSplineParams spline_params = ImGuiExt::HermiteSplineParams_Default;
     spline_params.ViewParams.ScaleRange.y = 1000.0f;
 
+    bool changed = false;
+
     if (ImGui::Button ("Reset to Cubiome Settings") || params->spline_stack.count == 0)
     {
+        changed = true;
         array_clear (&params->spline_stack);
         auto spline = array_push (&params->spline_stack);
         params->surface_spline = spline;
@@ -709,6 +825,11 @@ bool ui_surface_splines_editor (const char *str_id, Terrain_Params *params,
         print ("%.*s", fstr (str));
     }
 
+    ImGui::SameLine ();
+
+    if (ImGui::Button ("Benchmark Default Spline"))
+        hermite_spline_benchmark (&g_world, 1000);
+
     ImGui::Columns (2);
 
     ImVec2 size = {ImGui::GetContentRegionAvail ().x, 500.0f};
@@ -716,7 +837,7 @@ bool ui_surface_splines_editor (const char *str_id, Terrain_Params *params,
     {
         ImGuiExt::EndHermiteSpline ();
 
-        return false;
+        return changed;
     }
 
     auto spline = &params->spline_stack[*selected_spline];
@@ -739,6 +860,8 @@ bool ui_surface_splines_editor (const char *str_id, Terrain_Params *params,
             value_ptr = &knot->y;
         }
 
+        auto knot_before = *knot;
+
         ImGuiExt::HermiteSplinePointValues curr = {&knot->x, value_ptr, &knot->derivative};
         ImGuiExt::HermiteSplinePointValues next = {};
         if (i != spline->knots.count - 1)
@@ -785,15 +908,20 @@ bool ui_surface_splines_editor (const char *str_id, Terrain_Params *params,
                 knot->is_nested_spline = true;
                 knot->spline = array_push (&params->spline_stack);
                 *selected_spline = params->spline_stack.count - 1;
+                changed = true;
             }
         }
 
         knot->x = clamp (knot->x, 0.0f, 1.0f);
         knot->y = clamp (knot->y, 0.0f, 1.0f);
 
+        if (knot->x != knot_before.x || knot->y != knot_before.y || knot->derivative != knot_before.derivative)
+            changed = true;
+
         if (*selected_knot == i && ImGui::IsKeyPressed (ImGuiKey_Delete))
         {
             array_ordered_remove (&spline->knots, i);
+            changed = true;
         }
     }
 
@@ -825,6 +953,7 @@ bool ui_surface_splines_editor (const char *str_id, Terrain_Params *params,
             pt->y = mouse_pos.y;
             pt->is_nested_spline = false;
             pt->derivative = 0;
+            changed = true;
         }
     }
 
@@ -834,7 +963,8 @@ bool ui_surface_splines_editor (const char *str_id, Terrain_Params *params,
 
     static const char *TValue_Names[] = {"Continentalness","Erosion","Weirdness","Ridges"};
 
-    ImGui::Combo ("TValue", &spline->t_value_index, TValue_Names, 4);
+    if (ImGui::Combo ("TValue", &spline->t_value_index, TValue_Names, 4))
+        changed = true;
 
     for_array (i, t_values)
         ImGui::SliderFloat (TValue_Names[i], &t_values[i], 0, 1);
@@ -843,6 +973,58 @@ bool ui_surface_splines_editor (const char *str_id, Terrain_Params *params,
     ImGui::SliderInt ("Max Height", &params->height_range.y, params->height_range.x, Chunk_Height);
     ImGui::SliderInt ("Water Level", &params->water_level, 0, Chunk_Height);
 
+    static const char *Terrain_Sampling_Names[] = {"Full", "Bilinear", "Bicubic"};
+
+    int sampling = cast (int) params->sampling;
+    if (ImGui::Combo ("Terrain Sampling", &sampling, Terrain_Sampling_Names, array_size (Terrain_Sampling_Names)))
+        params->sampling = cast (Terrain_Sampling) sampling;
+
+    if (params->sampling != Terrain_Sampling_Full)
+    {
+        static const int Sample_Steps[] = {2, 4, 8, 16};
+        static const char *Sample_Step_Names[] = {"2", "4", "8", "16"};
+
+        int step_index = 0;
+        for_range (i, 0, cast (s64) array_size (Sample_Steps))
+        {
+            if (Sample_Steps[i] == params->sample_step)
+                step_index = cast (int) i;
+        }
+
+        if (ImGui::Combo ("Sample Step", &step_index, Sample_Step_Names, array_size (Sample_Step_Names)))
+            params->sample_step = Sample_Steps[step_index];
+    }
+
+    ImGui::Checkbox ("Bake Surface Spline", &params->bake_surface_spline);
+
+    if (params->bake_surface_spline)
+    {
+        auto lut = &g_world.surface_spline_lut;
+        if (lut->ready)
+        {
+            ImGui::Text ("Baked %lld values over %d dimensions, %lld exact cells, error max %.3f, average %.4f blocks",
+                lut->value_count, lut->dimension_count, lut->exact_cell_count, lut->max_error, lut->average_error);
+        }
+        else if (lut->value_count > 0)
+        {
+            // Baking the values and checking the cells take about as long
+            ImGui::ProgressBar ((lut->baked_count + lut->checked_count) / cast (f32) (2 * lut->value_count));
+        }
+    }
+
+    ImGui::Checkbox ("3D Density Terrain", &params->density_terrain);
+
+    if (params->density_terrain)
+    {
+        ImGui::SliderFloat ("Density Amplitude", &params->density_amplitude, 0, 64);
+
+        if (ImGui::TreeNode ("Density Noise"))
+        {
+            ui_show_perlin_fractal_params (ImGui::GetID ("Density Noise"), &params->density_noise);
+            ImGui::TreePop ();
+        }
+    }
+
     if (ImGui::Button ("Generate"))
     {
         world_clear_chunks (&g_world);
@@ -851,7 +1033,7 @@ bool ui_surface_splines_editor (const char *str_id, Terrain_Params *params,
 
     ImGui::Columns ();
 
-    return true;
+    return changed;
 }
 
 void ui_show_windows ()
@@ -929,8 +1111,16 @@ void ui_show_windows ()
 
         static float t_values[4];
 
-        ui_surface_splines_editor ("Surface Spline Editor", &g_world.terrain_params,
+        // Keep the spline used for generation in sync with the edits
+        bool spline_changed = ui_surface_splines_editor ("Surface Spline Editor", &g_world.terrain_params,
             &offset, &scale, &selected_spline, &selected_point, slice_make (4, t_values));
+
+        // The cached terrain values were computed with the previous spline
+        if (spline_changed)
+        {
+            hermite_spline_compile (g_world.terrain_params.surface_spline, &g_world.surface_spline);
+            terrain_cache_clear (&g_world.terrain_cache);
+        }
     }
     ImGui::End ();
 }
@@ -1,8 +1,59 @@
 #include "Minecraft.hpp"
 
+// Resets all the fields but the terrain values and blocks, which are filled in by generation
+void chunk_clear_fields (Chunk *chunk)
+{
+    chunk->east  = null;
+    chunk->west  = null;
+    chunk->north = null;
+    chunk->south = null;
+
+    chunk->x = 0;
+    chunk->z = 0;
+
+    chunk->total_vertex_count = 0;
+    for_range (i, 0, Chunk_Mesh_Count)
+    {
+        chunk->vertex_counts[i] = 0;
+        chunk->gl_vbos[i] = 0;
+        chunk->opengl_is_stupid_vaos[i] = 0;
+        chunk->vbo_capacities[i] = 0;
+
+        for_range (s, 0, Chunk_Section_Count + 1)
+            chunk->section_vertex_offsets[i][s] = 0;
+    }
+    chunk->mesh_lod = 0;
+    chunk->mesh_y_range = {};
+
+    chunk->gl_water_ebo = 0;
+    chunk->water_face_centers = {};
+    chunk->water_sort_camera_cell = {};
+    chunk->water_sort_valid = false;
+
+    chunk->gl_occlusion_query = 0;
+    chunk->occlusion_query_pending = false;
+    chunk->occluded = false;
+
+    chunk->is_dirty = false;
+    chunk->dirty_sections = 0;
+    chunk->stage = Chunk_Stage_Empty;
+
+    for_range (i, 0, Chunk_Section_Count)
+        chunk->section_types[i] = Block_Type_Air;
+
+    for_range (i, 0, Heightmap_Count)
+    {
+        for_range (j, 0, Chunk_Size * Chunk_Size)
+            chunk->heightmaps[i][j] = 0;
+    }
+
+    for_range (i, 0, Chunk_Neighbour_Count)
+        chunk->outgoing_edits[i] = {};
+}
+
 void chunk_init (Chunk *chunk, s64 x, s64 z)
 {
-    memset (chunk, 0, offsetof (Chunk, terrain_values));
+    chunk_clear_fields (chunk);
 
     chunk->x = x;
     chunk->z = z;
@@ -11,12 +62,22 @@ void chunk_init (Chunk *chunk, s64 x, s64 z)
 
     glGenVertexArrays (Chunk_Mesh_Count, chunk->opengl_is_stupid_vaos);
     glGenBuffers (Chunk_Mesh_Count, chunk->gl_vbos);
+    glGenQueries (1, &chunk->gl_occlusion_query);
+    glGenBuffers (1, &chunk->gl_water_ebo);
+
+    array_init (&chunk->water_face_centers, heap_allocator ());
+
+    for_range (i, 0, Chunk_Neighbour_Count)
+        array_init (&chunk->outgoing_edits[i], heap_allocator ());
 
     for_range (i, 0, Chunk_Mesh_Count)
     {
         glBindVertexArray (chunk->opengl_is_stupid_vaos[i]);
         glBindBuffer (GL_ARRAY_BUFFER, chunk->gl_vbos[i]);
 
+        if (i == Chunk_Mesh_Water)
+            glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, chunk->gl_water_ebo);
+
         glEnableVertexAttribArray (0);
         glVertexAttribPointer (0, 3, GL_FLOAT, GL_FALSE, sizeof (Vertex), cast (void *) offsetof (Vertex, position));
 
@@ -38,6 +99,12 @@ void chunk_cleanup (Chunk *chunk)
 {
     glDeleteVertexArrays (Chunk_Mesh_Count, chunk->opengl_is_stupid_vaos);
     glDeleteBuffers (Chunk_Mesh_Count, chunk->gl_vbos);
+    glDeleteQueries (1, &chunk->gl_occlusion_query);
+    glDeleteBuffers (1, &chunk->gl_water_ebo);
+    array_free (&chunk->water_face_centers);
+
+    for_range (i, 0, Chunk_Neighbour_Count)
+        array_free (&chunk->outgoing_edits[i]);
 }
 
 Vec2i chunk_absolute_to_relative_coordinates (Chunk *chunk, s64 x, s64 z)
@@ -45,9 +112,32 @@ Vec2i chunk_absolute_to_relative_coordinates (Chunk *chunk, s64 x, s64 z)
     return {cast (int) (x - chunk->x * Chunk_Size) - (x < 0), cast (int) (z - chunk->z * Chunk_Size) - (z < 0)};
 }
 
+// Rounds towards negative infinity, block -Chunk_Size is in chunk -1
 Vec2l chunk_position_from_block_position (s64 x, s64 z)
 {
-    return {x / Chunk_Size - (x < 0), z / Chunk_Size - (z < 0)};
+    return {(x + (x < 0)) / Chunk_Size - (x < 0), (z + (z < 0)) / Chunk_Size - (z < 0)};
+}
+
+// Keys for the Counter_RNG streams used during generation. The numbers only depend on
+// the world seed, the position and the salt (which tells apart the different uses at the
+// same position), never on the order chunks are generated in or on the thread doing it.
+// Chunk and block keys are combined with a different domain first, otherwise the key of
+// chunk (x, z) would be the key of block (x, 0, z) with the same salt.
+static const u64 Random_Key_Domain_Chunk = 0x63686e6b;
+static const u64 Random_Key_Domain_Block = 0x626c636b;
+
+u64 chunk_random_key (World *world, s64 chunk_x, s64 chunk_z, u64 salt)
+{
+    u64 key = random_key_combine (world->random_key, Random_Key_Domain_Chunk);
+
+    return random_key_combine (random_key_combine (key, salt), chunk_x, 0, chunk_z);
+}
+
+u64 block_random_key (World *world, s64 x, s64 y, s64 z, u64 salt)
+{
+    u64 key = random_key_combine (world->random_key, Random_Key_Domain_Block);
+
+    return random_key_combine (random_key_combine (key, salt), x, y, z);
 }
 
 Chunk *chunk_get_at_relative_coordinates (Chunk *chunk, s64 *x, s64 *z)
@@ -115,315 +205,2510 @@ Terrain_Values chunk_get_terrain_values (Chunk *chunk, s64 x, s64 z)
     return chunk->terrain_values[x * Chunk_Size + z];
 }
 
-void chunk_generate_cubiome (World *world, Chunk *chunk)
+static const int Cubiome_Cell_Size = 4;
+static const int Cubiome_Cells_Per_Chunk = Chunk_Size / Cubiome_Cell_Size;
+
+void cubiome_sampler_init (Cubiome_Sampler *sampler, World *world)
+{
+    *sampler = {};
+    sampler->generator = &world->cubiome_gen;
+}
+
+void cubiome_sampler_cleanup (Cubiome_Sampler *sampler)
 {
-    for_range (x, 0, Chunk_Size)
+    mem_free (sampler->biomes, heap_allocator ());
+    mem_free (sampler->climate, heap_allocator ());
+    *sampler = {};
+}
+
+// Samples the biome ids and the climate values of the biome cells of a region of chunks.
+// This is what genBiomes does for a 1:4 range, except it keeps the climate values that
+// genBiomes throws away, so the noise is only evaluated once per cell.
+void cubiome_sample_region (Cubiome_Sampler *sampler, s64 chunk_x, s64 chunk_z, s64 chunk_count_x, s64 chunk_count_z)
+{
+    cubiome::Range range = {};
+    range.scale = Cubiome_Cell_Size;
+    range.x  = cast (int) (chunk_x * Cubiome_Cells_Per_Chunk);
+    range.z  = cast (int) (chunk_z * Cubiome_Cells_Per_Chunk);
+    range.sx = cast (int) (chunk_count_x * Cubiome_Cells_Per_Chunk + 1);
+    range.sz = cast (int) (chunk_count_z * Cubiome_Cells_Per_Chunk + 1);
+    range.y  = 0;
+    range.sy = 1;
+
+    s64 cell_count = cast (s64) range.sx * range.sz;
+    if (cell_count > sampler->cell_capacity)
     {
-        for_range (z, 0, Chunk_Size)
-        {
-            int sample_x = x + chunk->x * Chunk_Size;
-            int sample_z = z + chunk->z * Chunk_Size;
+        mem_free (sampler->biomes, heap_allocator ());
+        mem_free (sampler->climate, heap_allocator ());
 
-            auto values = &chunk->terrain_values[x * Chunk_Size + z];
-            s64 np[6];
-            cubiome::sampleBiomeNoise (&world->cubiome_gen.bn, np, sample_x, 0, sample_z, null, 0);
+        s64 cache_size = cubiome::getMinCacheSize (sampler->generator, range.scale, range.sx, range.sy, range.sz);
+        sampler->biomes = mem_alloc_uninit (int, cache_size, heap_allocator ());
+        sampler->climate = mem_alloc_uninit (f32, cell_count * Cubiome_Climate_Count, heap_allocator ());
+        sampler->cell_capacity = cell_count;
+    }
 
-            values->noise[0] = cast (float) np[cubiome::NP_CONTINENTALNESS] / 10000.0f;
-            values->noise[1] = cast (float) np[cubiome::NP_EROSION] / 10000.0f;
-            values->noise[2] = cast (float) np[cubiome::NP_WEIRDNESS] / 10000.0f;
-            values->noise[3] = -3.0f * (fabsf (fabsf (values->noise[2]) - 0.6666667f) - 0.33333334f);
+    sampler->range = range;
 
-            values->noise[0] = inverse_lerp (-1.0f, 1.0f, values->noise[0]);
-            values->noise[1] = inverse_lerp (-1.0f, 1.0f, values->noise[1]);
-            values->noise[2] = inverse_lerp (-1.0f, 1.0f, values->noise[2]);
-            values->noise[3] = inverse_lerp (-1.0f, 1.0f, values->noise[3]);
+    for_range (j, 0, range.sz)
+    {
+        for_range (i, 0, range.sx)
+        {
+            s64 index = j * range.sx + i;
 
-            values->surface_level = 64 + np[cubiome::NP_DEPTH] / 76.0;
+            s64 np[6];
+            sampler->biomes[index] = cubiome::sampleBiomeNoise (&sampler->generator->bn, np,
+                range.x + cast (int) i, range.y, range.z + cast (int) j, &sampler->biome_cache, 0);
+
+            auto climate = &sampler->climate[index * Cubiome_Climate_Count];
+            climate[Cubiome_Climate_Continentalness] = cast (f32) np[cubiome::NP_CONTINENTALNESS] / 10000.0f;
+            climate[Cubiome_Climate_Erosion] = cast (f32) np[cubiome::NP_EROSION] / 10000.0f;
+            climate[Cubiome_Climate_Weirdness] = cast (f32) np[cubiome::NP_WEIRDNESS] / 10000.0f;
+            climate[Cubiome_Climate_Depth] = cast (f32) np[cubiome::NP_DEPTH];
         }
     }
 }
 
-void chunk_generate_mine (World *world, Chunk *chunk)
+// Fills the Chunk_Size * Chunk_Size terrain values of a chunk, in the same layout as Chunk.terrain_values.
+// The chunk is taken from the sampled region if it is in it, otherwise the cells of the chunk
+// alone are sampled. The climate values are bilinearly interpolated between the cell corners,
+// and the ridges are derived from the interpolated weirdness since the fold is not linear.
+void cubiome_sample_terrain_values (Cubiome_Sampler *sampler, s64 chunk_x, s64 chunk_z, Terrain_Values *values)
 {
-    f32 max_amplitude[3];
-    for_range (i, 0, 3)
-        max_amplitude[i] = perlin_fractal_max (world->terrain_params.noise[i].octaves, world->terrain_params.noise[i].persistance);
+    s64 first_cell_x = chunk_x * Cubiome_Cells_Per_Chunk;
+    s64 first_cell_z = chunk_z * Cubiome_Cells_Per_Chunk;
+
+    auto range = sampler->range;
+    if (range.sx == 0
+    || first_cell_x < range.x || first_cell_x + Cubiome_Cells_Per_Chunk >= range.x + range.sx
+    || first_cell_z < range.z || first_cell_z + Cubiome_Cells_Per_Chunk >= range.z + range.sz)
+    {
+        cubiome_sample_region (sampler, chunk_x, chunk_z, 1, 1);
+        range = sampler->range;
+    }
+
+    s64 offset_x = first_cell_x - range.x;
+    s64 offset_z = first_cell_z - range.z;
 
     for_range (x, 0, Chunk_Size)
     {
+        s64 cell_x = offset_x + x / Cubiome_Cell_Size;
+        f32 tx = (x % Cubiome_Cell_Size) / cast (f32) Cubiome_Cell_Size;
+
         for_range (z, 0, Chunk_Size)
         {
-            int sample_x = x + chunk->x * Chunk_Size;
-            int sample_z = z + chunk->z * Chunk_Size;
+            s64 cell_z = offset_z + z / Cubiome_Cell_Size;
+            f32 tz = (z % Cubiome_Cell_Size) / cast (f32) Cubiome_Cell_Size;
+
+            const f32 *c00 = &sampler->climate[(cell_z * range.sx + cell_x) * Cubiome_Climate_Count];
+            const f32 *c10 = c00 + Cubiome_Climate_Count;
+            const f32 *c01 = c00 + range.sx * Cubiome_Climate_Count;
+            const f32 *c11 = c01 + Cubiome_Climate_Count;
+
+            f32 climate[Cubiome_Climate_Count];
+            for_range (i, 0, Cubiome_Climate_Count)
+                climate[i] = lerp (lerp (c00[i], c10[i], tx), lerp (c01[i], c11[i], tx), tz);
+
+            auto value = &values[x * Chunk_Size + z];
+            value->noise[0] = climate[Cubiome_Climate_Continentalness];
+            value->noise[1] = climate[Cubiome_Climate_Erosion];
+            value->noise[2] = climate[Cubiome_Climate_Weirdness];
+            value->noise[3] = -3.0f * (fabsf (fabsf (value->noise[2]) - 0.6666667f) - 0.33333334f);
+
+            value->noise[0] = inverse_lerp (-1.0f, 1.0f, value->noise[0]);
+            value->noise[1] = inverse_lerp (-1.0f, 1.0f, value->noise[1]);
+            value->noise[2] = inverse_lerp (-1.0f, 1.0f, value->noise[2]);
+            value->noise[3] = inverse_lerp (-1.0f, 1.0f, value->noise[3]);
+
+            value->surface_level = 64 + climate[Cubiome_Climate_Depth] / 76.0f;
+        }
+    }
+}
+
+void chunk_generate_cubiome (Chunk *chunk, Cubiome_Sampler *sampler)
+{
+    cubiome_sample_terrain_values (sampler, chunk->x, chunk->z, chunk->terrain_values);
+}
 
-            auto values = &chunk->terrain_values[x * Chunk_Size + z];
-            values->noise[0] = perlin_fractal_noise (world->terrain_params.noise[0], world->noise_offsets[0], sample_x, sample_z);
-            values->noise[1] = perlin_fractal_noise (world->terrain_params.noise[1], world->noise_offsets[1], sample_x, sample_z);
-            values->noise[2] = perlin_fractal_noise (world->terrain_params.noise[2], world->noise_offsets[2], sample_x, sample_z);
+struct Cubiome_Sampling_Job
+{
+    World *world;
+    const Vec2l *chunk_positions;
+    Terrain_Values *values;
+    s64 first_chunk;
+    s64 chunk_count;
+};
+
+s32 cubiome_sampling_thread_proc (Thread *thread)
+{
+    auto job = cast (Cubiome_Sampling_Job *) thread->data;
 
-            values->noise[0] = inverse_lerp (-max_amplitude[0], max_amplitude[0], values->noise[0]);
-            values->noise[1] = inverse_lerp (-max_amplitude[1], max_amplitude[1], values->noise[1]);
-            values->noise[2] = inverse_lerp (-max_amplitude[2], max_amplitude[2], values->noise[2]);
+    Cubiome_Sampler sampler;
+    cubiome_sampler_init (&sampler, job->world);
+    defer (cubiome_sampler_cleanup (&sampler));
 
-            values->noise[3] = values->noise[2] * 2 - 1;
-            values->noise[3] = -3.0f * (fabsf (fabsf (values->noise[3]) - 0.6666667f) - 0.33333334f);
-            values->noise[3] = inverse_lerp (-1.0f, 1.0f, values->noise[3]);
+    if (job->chunk_count <= 0)
+        return 0;
 
-            values->surface_level = hermite_cubic_calculate (world->terrain_params.surface_spline, slice_make (array_size (values->noise), values->noise));
-            values->surface_level = lerp (cast (f32) world->terrain_params.height_range.x, cast (f32) world->terrain_params.height_range.y, values->surface_level);
-        }
+    // Sample all the chunks of the job as one region if they are packed closely enough,
+    // so the cells on the chunk borders are only sampled once
+    Vec2l region_min = job->chunk_positions[job->first_chunk];
+    Vec2l region_max = region_min;
+    for_range (i, job->first_chunk, job->first_chunk + job->chunk_count)
+    {
+        auto position = job->chunk_positions[i];
+        region_min.x = min (region_min.x, position.x);
+        region_min.y = min (region_min.y, position.y);
+        region_max.x = max (region_max.x, position.x);
+        region_max.y = max (region_max.y, position.y);
+    }
+
+    s64 region_area = (region_max.x - region_min.x + 1) * (region_max.y - region_min.y + 1);
+    if (region_area <= job->chunk_count * 2)
+        cubiome_sample_region (&sampler, region_min.x, region_min.y, region_max.x - region_min.x + 1, region_max.y - region_min.y + 1);
+
+    for_range (i, job->first_chunk, job->first_chunk + job->chunk_count)
+    {
+        auto position = job->chunk_positions[i];
+        cubiome_sample_terrain_values (&sampler, position.x, position.y, job->values + i * Chunk_Size * Chunk_Size);
     }
+
+    return 0;
 }
 
-void chunk_generate (World *world, Chunk *chunk)
+// Samples the terrain values of the chunks at the given positions, splitting them in
+// contiguous ranges between thread_count threads that each have their own sampler
+void cubiome_sample_terrain_values_parallel (World *world, s64 chunk_count, const Vec2l *chunk_positions, Terrain_Values *values, int thread_count)
 {
-    if (chunk->generated)
+    static const int Max_Threads = 64;
+
+    thread_count = cast (int) clamp (cast (s64) thread_count, cast (s64) 1, min (chunk_count, cast (s64) Max_Threads));
+
+    Cubiome_Sampling_Job jobs[Max_Threads];
+    Thread threads[Max_Threads];
+    Thread *thread_ptrs[Max_Threads];
+
+    s64 first_chunk = 0;
+    for_range (i, 0, thread_count)
+    {
+        s64 count = chunk_count / thread_count + (i < chunk_count % thread_count);
+        jobs[i] = {world, chunk_positions, values, first_chunk, count};
+        first_chunk += count;
+    }
+
+    if (thread_count <= 1)
+    {
+        Thread thread = {};
+        thread.data = &jobs[0];
+        cubiome_sampling_thread_proc (&thread);
+
         return;
+    }
+
+    int started_count = 0;
+    for_range (i, 0, thread_count)
+    {
+        if (!thread_init (&threads[i], cubiome_sampling_thread_proc, &jobs[i]))
+        {
+            // Do the work of the threads that could not be created on this one
+            Thread thread = {};
+            thread.data = &jobs[i];
+            cubiome_sampling_thread_proc (&thread);
+
+            continue;
+        }
+
+        thread_ptrs[started_count] = &threads[i];
+        started_count += 1;
+        thread_start (&threads[i]);
+    }
+
+    thread_wait_multiple (slice_make (cast (s64) started_count, thread_ptrs));
+
+    for_range (i, 0, started_count)
+        thread_cleanup (thread_ptrs[i]);
+}
+
+// Samples the same chunks with one thread and with one thread per processor, checks that
+// the results are the same and prints the timings to the console
+void cubiome_benchmark (World *world, int chunk_count)
+{
+    int side = max (cast (int) sqrtf (cast (f32) chunk_count), 1);
+    chunk_count = side * side;
+
+    auto positions = mem_alloc_uninit (Vec2l, chunk_count, heap_allocator ());
+    auto single_values = mem_alloc_uninit (Terrain_Values, chunk_count * Chunk_Size * Chunk_Size, heap_allocator ());
+    auto parallel_values = mem_alloc_uninit (Terrain_Values, chunk_count * Chunk_Size * Chunk_Size, heap_allocator ());
+
+    for_range (i, 0, chunk_count)
+        positions[i] = {i % side - side / 2, i / side - side / 2};
+
+    int thread_count = get_processor_count ();
+
+    s64 start = time_current_monotonic ();
+    cubiome_sample_terrain_values_parallel (world, chunk_count, positions, single_values, 1);
+    s64 single_time = time_current_monotonic () - start;
 
-    defer (chunk->generated = true);
+    start = time_current_monotonic ();
+    cubiome_sample_terrain_values_parallel (world, chunk_count, positions, parallel_values, thread_count);
+    s64 parallel_time = time_current_monotonic () - start;
 
-    // chunk_generate_cubiome (world, chunk);
-    chunk_generate_mine (world, chunk);
+    bool same = memcmp (single_values, parallel_values, sizeof (Terrain_Values) * chunk_count * Chunk_Size * Chunk_Size) == 0;
 
-    for_range (i, 0, Chunk_Size)
+    println ("[CUBIOMES] Sampled %d chunks: 1 thread %.2f ms, %d threads %.2f ms (x%.2f), results %s",
+        chunk_count, single_time / 1000.0, thread_count, parallel_time / 1000.0,
+        single_time / cast (f64) max (parallel_time, cast (s64) 1), same ? "match" : "DIFFER");
+
+    mem_free (positions, heap_allocator ());
+    mem_free (single_values, heap_allocator ());
+    mem_free (parallel_values, heap_allocator ());
+}
+
+inline
+void terrain_values_normalize_noise (const f32 max_amplitude[3], Terrain_Values *values)
+{
+    values->noise[0] = inverse_lerp (-max_amplitude[0], max_amplitude[0], values->noise[0]);
+    values->noise[1] = inverse_lerp (-max_amplitude[1], max_amplitude[1], values->noise[1]);
+    values->noise[2] = inverse_lerp (-max_amplitude[2], max_amplitude[2], values->noise[2]);
+
+    values->noise[3] = values->noise[2] * 2 - 1;
+    values->noise[3] = -3.0f * (fabsf (fabsf (values->noise[3]) - 0.6666667f) - 0.33333334f);
+    values->noise[3] = inverse_lerp (-1.0f, 1.0f, values->noise[3]);
+}
+
+// FNV-1a over the parts of the compiled spline that are in use
+u64 compiled_spline_hash (const Compiled_Hermite_Spline *spline)
+{
+    static const u64 Offset_Basis = 0xcbf29ce484222325;
+    static const u64 Prime        = 0x00000100000001b3;
+
+    u64 hash = Offset_Basis;
+    auto hash_bytes = [&](const void *data, s64 size)
     {
-        for_range (j, 0, Chunk_Height)
+        for_range (i, 0, size)
         {
-            for_range (k, 0, Chunk_Size)
-            {
-                s64 index = chunk_block_index (i, j, k);
+            hash ^= (cast (const u8 *) data)[i];
+            hash *= Prime;
+        }
+    };
+
+    hash_bytes (&spline->spline_count, sizeof (spline->spline_count));
+    hash_bytes (spline->t_value_indices, sizeof (s32) * spline->spline_count);
+    hash_bytes (spline->first_knots, sizeof (s32) * spline->spline_count);
+    hash_bytes (spline->knot_counts, sizeof (s32) * spline->spline_count);
+    hash_bytes (spline->knot_x, sizeof (f32) * spline->knot_count);
+    hash_bytes (spline->knot_y, sizeof (f32) * spline->knot_count);
+    hash_bytes (spline->knot_derivatives, sizeof (f32) * spline->knot_count);
+    hash_bytes (spline->knot_children, sizeof (s32) * spline->knot_count);
+
+    return hash;
+}
 
-                f32 surface_level = chunk_get_terrain_values (chunk, i, k).surface_level;
+void surface_spline_lut_free (Surface_Spline_Lut *lut)
+{
+    mem_free (lut->values, heap_allocator ());
+    mem_free (lut->exact_cells, heap_allocator ());
+    memset (lut, 0, sizeof (Surface_Spline_Lut));
+}
 
-                if (j == 0)
-                {
-                    chunk->blocks[index].type = Block_Type_Bedrock;
-                }
-                else if (j > surface_level)
-                {
-                    if (j <= world->terrain_params.water_level)
-                        chunk->blocks[index].type = Block_Type_Water;
-                    else
-                        chunk->blocks[index].type = Block_Type_Air;
-                }
-                else if (j > surface_level - Surface_Dirt_Height)
-                {
-                    chunk->blocks[index].type = Block_Type_Dirt;
-                }
-                else
-                {
-                    chunk->blocks[index].type = Block_Type_Stone;
-                }
+int compare_f32 (const f32 &a, const f32 &b)
+{
+    return (a > b) - (a < b);
+}
+
+// Sets the values of dimension i to a uniform grid of lut->resolution points over [0, 1] and
+// the x of the knots of the splines on that dimension, and returns their count
+int surface_spline_lut_build_axis (Surface_Spline_Lut *lut, const Compiled_Hermite_Spline *spline, s64 i)
+{
+    // Knots closer than this to another value would make cells too thin to interpolate
+    static const f32 Min_Spacing = 1.0e-5f;
+
+    f32 *axis = lut->axis_values[i];
+    int count = 0;
+    for_range (j, 0, lut->resolution)
+    {
+        axis[count] = j / cast (f32) (lut->resolution - 1);
+        count += 1;
+    }
+
+    for_range (s, 0, spline->spline_count)
+    {
+        if (spline->t_value_indices[s] != lut->dimensions[i])
+            continue;
+
+        for_range (k, spline->first_knots[s], spline->first_knots[s] + spline->knot_counts[s])
+        {
+            if (spline->knot_x[k] > 0 && spline->knot_x[k] < 1)
+            {
+                axis[count] = spline->knot_x[k];
+                count += 1;
             }
         }
     }
+
+    sort (slice_make (count, axis), compare_f32);
+
+    int unique_count = 1;
+    for_range (j, 1, count)
+    {
+        if (axis[j] - axis[unique_count - 1] >= Min_Spacing)
+        {
+            axis[unique_count] = axis[j];
+            unique_count += 1;
+        }
+    }
+
+    // Uniform points removed for being too close to a knot look up the knot before them
+    int index = 0;
+    for_range (j, 0, lut->resolution)
+    {
+        f32 t = j / cast (f32) (lut->resolution - 1);
+        while (index < unique_count - 1 && axis[index + 1] <= t)
+            index += 1;
+
+        lut->axis_lookup[i][j] = cast (s16) index;
+    }
+
+    return unique_count;
 }
 
-void push_block (Array<Vertex> *vertices, u8 id, const Vec3f &position, Block_Face_Flags visible_faces)
+// Only the T values the spline depends on get a dimension, so the default spline
+// (continentalness, erosion and ridges) gets a finer 3D table instead of a 4D one
+void surface_spline_lut_start_bake (World *world, u64 spline_hash)
 {
-    if (visible_faces & Block_Face_Flag_East)
-    {
-        auto v = array_push (vertices, {position, Block_Face_East, id, Block_Corner_Bottom_Left});
-        v->position += {0.5, -0.5, -0.5};
+    static const int Resolutions[] = {Surface_Spline_Lut_Max_Resolution, 65, 33, 17, 9};
 
-        v = array_push (vertices, {position, Block_Face_East, id, Block_Corner_Top_Left});
-        v->position += {0.5, 0.5, -0.5};
+    auto lut = &world->surface_spline_lut;
+    surface_spline_lut_free (lut);
+    lut->spline_hash = spline_hash;
 
-        v = array_push (vertices, {position, Block_Face_East, id, Block_Corner_Top_Right});
-        v->position += {0.5, 0.5, 0.5};
+    bool used[4] = {};
+    for_range (i, 0, world->surface_spline.spline_count)
+        used[world->surface_spline.t_value_indices[i]] = true;
 
-        v = array_push (vertices, {position, Block_Face_East, id, Block_Corner_Bottom_Left});
-        v->position += {0.5, -0.5, -0.5};
+    for_range (i, 0, 4)
+    {
+        if (used[i])
+        {
+            lut->dimensions[lut->dimension_count] = cast (int) i;
+            lut->dimension_count += 1;
+        }
+    }
 
-        v = array_push (vertices, {position, Block_Face_East, id, Block_Corner_Top_Right});
-        v->position += {0.5, 0.5, 0.5};
+    for_range (i, 0, cast (s64) array_size (Resolutions))
+    {
+        lut->resolution = Resolutions[i];
+        lut->value_count = 1;
+        for_range (j, 0, lut->dimension_count)
+        {
+            lut->axis_counts[j] = surface_spline_lut_build_axis (lut, &world->surface_spline, j);
+            lut->strides[j] = lut->value_count;
+            lut->value_count *= lut->axis_counts[j];
+        }
 
-        v = array_push (vertices, {position, Block_Face_East, id, Block_Corner_Bottom_Right});
-        v->position += {0.5, -0.5, 0.5};
+        if (lut->value_count <= Surface_Spline_Lut_Max_Values)
+            break;
     }
 
-    if (visible_faces & Block_Face_Flag_West)
+    // Generation keeps using the exact spline
+    if (lut->value_count > Surface_Spline_Lut_Max_Values)
     {
-        auto v = array_push (vertices, {position, Block_Face_West, id, Block_Corner_Bottom_Right});
-        v->position += {-0.5, -0.5, -0.5};
+        println ("[WORLD] Could not bake the surface spline, it has too many knots");
+        lut->value_count = 0;
 
-        v = array_push (vertices, {position, Block_Face_West, id, Block_Corner_Top_Left});
-        v->position += {-0.5, 0.5, 0.5};
+        return;
+    }
 
-        v = array_push (vertices, {position, Block_Face_West, id, Block_Corner_Top_Right});
-        v->position += {-0.5, 0.5, -0.5};
+    lut->values = mem_alloc_uninit (f32, lut->value_count, heap_allocator ());
+    lut->exact_cells = mem_alloc_typed (u64, (lut->value_count + 63) / 64, heap_allocator ());
+}
 
-        v = array_push (vertices, {position, Block_Face_West, id, Block_Corner_Bottom_Right});
-        v->position += {-0.5, -0.5, -0.5};
+// Interpolates the values of the cell that contains t_values, and sets cell to the index of
+// its first value
+f32 surface_spline_lut_interpolate (const Surface_Spline_Lut *lut, const f32 t_values[4], s64 *cell_index)
+{
+    // Weights and indices of the corners of the cell, doubled for each dimension
+    f32 weights[16] = {1};
+    s64 indices[16] = {0};
+    int corner_count = 1;
+    for_range (i, 0, lut->dimension_count)
+    {
+        const f32 *axis = lut->axis_values[i];
+        f32 t = clamp (t_values[lut->dimensions[i]], 0.0f, 1.0f);
 
-        v = array_push (vertices, {position, Block_Face_West, id, Block_Corner_Bottom_Left});
-        v->position += {-0.5, -0.5, 0.5};
+        // Start from the uniform grid, then step over the knots that come before t
+        int cell = lut->axis_lookup[i][min (cast (int) (t * (lut->resolution - 1)), lut->resolution - 2)];
+        while (cell < lut->axis_counts[i] - 2 && axis[cell + 1] <= t)
+            cell += 1;
 
-        v = array_push (vertices, {position, Block_Face_West, id, Block_Corner_Top_Left});
-        v->position += {-0.5, 0.5, 0.5};
+        f32 fraction = (t - axis[cell]) / (axis[cell + 1] - axis[cell]);
+
+        for_range (j, 0, corner_count)
+        {
+            indices[j] += cell * lut->strides[i];
+            indices[j + corner_count] = indices[j] + lut->strides[i];
+            weights[j + corner_count] = weights[j] * fraction;
+            weights[j] *= 1 - fraction;
+        }
+
+        corner_count *= 2;
     }
 
-    if (visible_faces & Block_Face_Flag_Above)
-    {
-        auto v = array_push (vertices, {position, Block_Face_Above, id, Block_Corner_Bottom_Left});
-        v->position += {-0.5, 0.5, -0.5};
+    f32 result = 0;
+    for_range (i, 0, corner_count)
+        result += weights[i] * lut->values[indices[i]];
 
-        v = array_push (vertices, {position, Block_Face_Above, id, Block_Corner_Top_Right});
-        v->position += {0.5, 0.5, 0.5};
+    *cell_index = indices[0];
 
-        v = array_push (vertices, {position, Block_Face_Above, id, Block_Corner_Bottom_Right});
-        v->position += {0.5, 0.5, -0.5};
+    return result;
+}
 
-        v = array_push (vertices, {position, Block_Face_Above, id, Block_Corner_Bottom_Left});
-        v->position += {-0.5, 0.5, -0.5};
+// Returns false if the cell of t_values has to be evaluated with the exact spline
+bool surface_spline_lut_sample (const Surface_Spline_Lut *lut, const f32 t_values[4], f32 *result)
+{
+    s64 cell;
+    *result = surface_spline_lut_interpolate (lut, t_values, &cell);
 
-        v = array_push (vertices, {position, Block_Face_Above, id, Block_Corner_Top_Left});
-        v->position += {-0.5, 0.5, 0.5};
+    return !(lut->exact_cells[cell / 64] & (1ull << (cell % 64)));
+}
 
-        v = array_push (vertices, {position, Block_Face_Above, id, Block_Corner_Top_Right});
-        v->position += {0.5, 0.5, 0.5};
+// Compares the table against the nested spline at random T values
+void surface_spline_lut_measure_error (World *world)
+{
+    auto lut = &world->surface_spline_lut;
+    if (!world->terrain_params.surface_spline)
+        return;
+
+    f32 height = cast (f32) (world->terrain_params.height_range.y - world->terrain_params.height_range.x);
+
+    Counter_RNG rng;
+    random_seed (&rng, 0);
+
+    f64 error_sum = 0;
+    lut->max_error = 0;
+    for_range (i, 0, Surface_Spline_Lut_Error_Samples)
+    {
+        f32 t_values[4];
+        for_range (j, 0, 4)
+            t_values[j] = random_rangef (&rng, 0, 1);
+
+        f32 exact = hermite_cubic_calculate (world->terrain_params.surface_spline, slice_make (4, t_values));
+        f32 sampled;
+        if (!surface_spline_lut_sample (lut, t_values, &sampled))
+            sampled = hermite_spline_evaluate (&world->surface_spline, t_values);
+
+        f32 error = fabsf (sampled - exact) * height;
+
+        error_sum += error;
+        lut->max_error = max (lut->max_error, error);
     }
 
-    if (visible_faces & Block_Face_Flag_Below)
+    lut->average_error = cast (f32) (error_sum / Surface_Spline_Lut_Error_Samples);
+
+    println ("[WORLD] Baked surface spline into %lld values over %d dimensions, %lld cells use the exact spline, error against the exact spline: max %.3f blocks, average %.4f blocks",
+        lut->value_count, lut->dimension_count, lut->exact_cell_count, lut->max_error, lut->average_error);
+}
+
+// Compares the cells to the spline along their diagonal, and marks the ones that are too far
+// from it. Where the spline is steep, a cell often spans an S shaped part of it, whose error
+// changes sign at the center of the cell, so the center alone is not enough.
+void surface_spline_lut_check_step (World *world, s64 max_cells)
+{
+    static const f32 Check_Fractions[] = {0.25f, 0.5f, 0.75f};
+
+    auto lut = &world->surface_spline_lut;
+    s64 count = min (max_cells, lut->value_count - lut->checked_count);
+
+    auto state = arena_get_state (&frame_arena);
+    defer (arena_set_state (&frame_arena, state));
+
+    f32 *t_values[4];
+    for_range (i, 0, 4)
+        t_values[i] = mem_alloc_typed (f32, count, frame_allocator);
+    f32 *exact = mem_alloc_uninit (f32, count, frame_allocator);
+
+    // Values on the last point of a dimension do not start a cell
+    bool *is_cell = mem_alloc_uninit (bool, count, frame_allocator);
+    for_range (j, 0, count)
+        is_cell[j] = true;
+
+    f32 height = cast (f32) (world->terrain_params.height_range.y - world->terrain_params.height_range.x);
+    f32 max_error = Surface_Spline_Lut_Max_Cell_Error / max (height, 1.0f);
+
+    for_range (f, 0, cast (s64) array_size (Check_Fractions))
     {
-        auto v = array_push (vertices, {position, Block_Face_Below, id, Block_Corner_Top_Left});
-        v->position += {-0.5, -0.5, -0.5};
+        for_range (i, 0, lut->dimension_count)
+        {
+            const f32 *axis = lut->axis_values[i];
+            f32 *dimension_t_values = t_values[lut->dimensions[i]];
+            for_range (j, 0, count)
+            {
+                s64 cell = ((lut->checked_count + j) / lut->strides[i]) % lut->axis_counts[i];
+                if (cell == lut->axis_counts[i] - 1)
+                {
+                    is_cell[j] = false;
+                    dimension_t_values[j] = axis[cell];
+                }
+                else
+                {
+                    dimension_t_values[j] = lerp (axis[cell], axis[cell + 1], Check_Fractions[f]);
+                }
+            }
+        }
 
-        v = array_push (vertices, {position, Block_Face_Below, id, Block_Corner_Top_Right});
-        v->position += {0.5, -0.5, -0.5};
+        hermite_spline_evaluate_batch (&world->surface_spline, t_values, count, exact);
 
-        v = array_push (vertices, {position, Block_Face_Below, id, Block_Corner_Bottom_Right});
-        v->position += {0.5, -0.5, 0.5};
+        for_range (j, 0, count)
+        {
+            if (!is_cell[j])
+                continue;
+
+            f32 cell_t_values[4] = {t_values[0][j], t_values[1][j], t_values[2][j], t_values[3][j]};
+            s64 cell;
+            f32 interpolated = surface_spline_lut_interpolate (lut, cell_t_values, &cell);
+            u64 cell_bit = 1ull << (cell % 64);
+            if (fabsf (interpolated - exact[j]) > max_error && !(lut->exact_cells[cell / 64] & cell_bit))
+            {
+                lut->exact_cells[cell / 64] |= cell_bit;
+                lut->exact_cell_count += 1;
+            }
+        }
+    }
 
-        v = array_push (vertices, {position, Block_Face_Below, id, Block_Corner_Top_Left});
-        v->position += {-0.5, -0.5, -0.5};
+    lut->checked_count += count;
+    if (lut->checked_count == lut->value_count)
+    {
+        lut->ready = true;
+        surface_spline_lut_measure_error (world);
+    }
+}
 
-        v = array_push (vertices, {position, Block_Face_Below, id, Block_Corner_Bottom_Right});
-        v->position += {0.5, -0.5, 0.5};
+void surface_spline_lut_bake_step (World *world, s64 max_values)
+{
+    auto lut = &world->surface_spline_lut;
+    s64 count = min (max_values, lut->value_count - lut->baked_count);
 
-        v = array_push (vertices, {position, Block_Face_Below, id, Block_Corner_Bottom_Left});
-        v->position += {-0.5, -0.5, 0.5};
+    auto state = arena_get_state (&frame_arena);
+    defer (arena_set_state (&frame_arena, state));
+
+    f32 *t_values[4];
+    for_range (i, 0, 4)
+    {
+        t_values[i] = mem_alloc_uninit (f32, count, frame_allocator);
+        for_range (j, 0, count)
+            t_values[i][j] = 0;
     }
 
-    if (visible_faces & Block_Face_Flag_North)
+    for_range (i, 0, lut->dimension_count)
     {
-        auto v = array_push (vertices, {position, Block_Face_North, id, Block_Corner_Bottom_Right});
-        v->position += {-0.5, -0.5, 0.5};
+        f32 *dimension_t_values = t_values[lut->dimensions[i]];
+        for_range (j, 0, count)
+        {
+            s64 cell = ((lut->baked_count + j) / lut->strides[i]) % lut->axis_counts[i];
+            dimension_t_values[j] = lut->axis_values[i][cell];
+        }
+    }
 
-        v = array_push (vertices, {position, Block_Face_North, id, Block_Corner_Bottom_Left});
-        v->position += {0.5, -0.5, 0.5};
+    hermite_spline_evaluate_batch (&world->surface_spline, t_values, count, lut->values + lut->baked_count);
 
-        v = array_push (vertices, {position, Block_Face_North, id, Block_Corner_Top_Left});
-        v->position += {0.5, 0.5, 0.5};
+    lut->baked_count += count;
+}
 
-        v = array_push (vertices, {position, Block_Face_North, id, Block_Corner_Bottom_Right});
-        v->position += {-0.5, -0.5, 0.5};
+// Bakes the next values of the table, then checks the next cells once all the values are baked
+void surface_spline_lut_advance (World *world, s64 max_values)
+{
+    auto lut = &world->surface_spline_lut;
+    if (lut->baked_count < lut->value_count)
+        surface_spline_lut_bake_step (world, max_values);
+    else
+        surface_spline_lut_check_step (world, max_values);
+}
 
-        v = array_push (vertices, {position, Block_Face_North, id, Block_Corner_Top_Left});
-        v->position += {0.5, 0.5, 0.5};
+void surface_spline_lut_bake_all (World *world)
+{
+    auto lut = &world->surface_spline_lut;
+    u64 hash = compiled_spline_hash (&world->surface_spline);
+    if (lut->spline_hash != hash)
+        surface_spline_lut_start_bake (world, hash);
 
-        v = array_push (vertices, {position, Block_Face_North, id, Block_Corner_Top_Right});
-        v->position += {-0.5, 0.5, 0.5};
-    }
+    while (lut->values && !lut->ready)
+        surface_spline_lut_advance (world, Surface_Spline_Lut_Bake_Values_Per_Frame);
+}
 
-    if (visible_faces & Block_Face_Flag_South)
+// Called every frame, restarts the bake when the spline was edited and bakes a slice of the table
+void world_update_surface_spline_lut (World *world)
+{
+    auto lut = &world->surface_spline_lut;
+    if (!world->terrain_params.bake_surface_spline || world->surface_spline.spline_count == 0)
     {
-        auto v = array_push (vertices, {position, Block_Face_South, id, Block_Corner_Bottom_Left});
-        v->position += {-0.5, -0.5, -0.5};
+        if (lut->spline_hash)
+            surface_spline_lut_free (lut);
+
+        return;
+    }
+
+    u64 hash = compiled_spline_hash (&world->surface_spline);
+    if (lut->spline_hash != hash)
+        surface_spline_lut_start_bake (world, hash);
+
+    if (lut->values && !lut->ready)
+        surface_spline_lut_advance (world, Surface_Spline_Lut_Bake_Values_Per_Frame);
+}
+
+inline
+f32 world_surface_spline_calculate (World *world, const f32 t_values[4])
+{
+    f32 result;
+    if (world->terrain_params.bake_surface_spline && world->surface_spline_lut.ready
+     && surface_spline_lut_sample (&world->surface_spline_lut, t_values, &result))
+        return result;
+
+    return hermite_spline_evaluate (&world->surface_spline, t_values);
+}
+
+// Expects the first 3 noise values to be the raw fractal noise values
+inline
+void terrain_values_from_noise (World *world, const f32 max_amplitude[3], Terrain_Values *values)
+{
+    terrain_values_normalize_noise (max_amplitude, values);
+
+    values->surface_level = world_surface_spline_calculate (world, values->noise);
+    values->surface_level = lerp (cast (f32) world->terrain_params.height_range.x, cast (f32) world->terrain_params.height_range.y, values->surface_level);
+}
+
+// Same as terrain_values_from_noise, with the surface spline evaluated for all values at once
+void terrain_values_from_noise_batch (World *world, const f32 max_amplitude[3], s64 count, Terrain_Values *values)
+{
+    auto state = arena_get_state (&frame_arena);
+    defer (arena_set_state (&frame_arena, state));
+
+    f32 *t_values[4];
+    for_range (i, 0, 4)
+        t_values[i] = mem_alloc_uninit (f32, count, frame_allocator);
+    f32 *surface_levels = mem_alloc_uninit (f32, count, frame_allocator);
+
+    for_range (i, 0, count)
+    {
+        terrain_values_normalize_noise (max_amplitude, &values[i]);
+
+        for_range (j, 0, 4)
+            t_values[j][i] = values[i].noise[j];
+    }
+
+    if (world->terrain_params.bake_surface_spline && world->surface_spline_lut.ready)
+    {
+        for_range (i, 0, count)
+        {
+            if (!surface_spline_lut_sample (&world->surface_spline_lut, values[i].noise, &surface_levels[i]))
+                surface_levels[i] = hermite_spline_evaluate (&world->surface_spline, values[i].noise);
+        }
+    }
+    else
+    {
+        hermite_spline_evaluate_batch (&world->surface_spline, t_values, count, surface_levels);
+    }
+
+    for_range (i, 0, count)
+        values[i].surface_level = lerp (cast (f32) world->terrain_params.height_range.x, cast (f32) world->terrain_params.height_range.y, surface_levels[i]);
+}
+
+inline
+void terrain_values_calculate (World *world, const f32 max_amplitude[3], int sample_x, int sample_z, Terrain_Values *values)
+{
+    values->noise[0] = perlin_fractal_noise (world->terrain_params.noise[0], world->noise_offsets[0], world->noise_permutations[0], sample_x, sample_z);
+    values->noise[1] = perlin_fractal_noise (world->terrain_params.noise[1], world->noise_offsets[1], world->noise_permutations[1], sample_x, sample_z);
+    values->noise[2] = perlin_fractal_noise (world->terrain_params.noise[2], world->noise_offsets[2], world->noise_permutations[2], sample_x, sample_z);
+
+    terrain_values_from_noise (world, max_amplitude, values);
+}
+
+void terrain_values_max_amplitude (World *world, f32 max_amplitude[3])
+{
+    for_range (i, 0, 3)
+        max_amplitude[i] = perlin_fractal_max (world->terrain_params.noise[i].octaves, world->terrain_params.noise[i].persistance);
+}
+
+// Takes the values from the terrain cache if the region of the column is in it, so that they match
+// the chunks. A single column is not worth generating a whole region for, so it is computed otherwise
+Terrain_Values world_sample_terrain_values (World *world, s64 x, s64 z)
+{
+    auto cached = terrain_cache_find_column (&world->terrain_cache, x, z);
+    if (cached)
+        return *cached;
+
+    f32 max_amplitude[3];
+    terrain_values_max_amplitude (world, max_amplitude);
+
+    Terrain_Values values;
+    terrain_values_calculate (world, max_amplitude, cast (int) x, cast (int) z, &values);
+
+    return values;
+}
+
+// The 4 noise values and the surface level
+static const int Terrain_Values_Field_Count = 5;
+
+inline
+f32 *terrain_values_field (Terrain_Values *values, s64 field)
+{
+    if (field < cast (s64) array_size (values->noise))
+        return &values->noise[field];
+
+    return &values->surface_level;
+}
+
+inline
+f32 cubic_interpolate (f32 p0, f32 p1, f32 p2, f32 p3, f32 t)
+{
+    // Catmull-Rom spline going through p1 and p2
+    return p1 + 0.5f * t * (p2 - p0 + t * (2 * p0 - 5 * p1 + 4 * p2 - p3 + t * (3 * (p1 - p2) + p3 - p0)));
+}
+
+// Generates the terrain values of a width * width square of columns starting at (start_x, start_z),
+// stored as values[x * width + z]. The lattice of the coarse modes is aligned to the world, so the
+// results do not depend on how the columns are split between calls.
+void terrain_values_generate_coarse (World *world, const f32 max_amplitude[3], s64 start_x, s64 start_z, int width, Terrain_Values *values)
+{
+    auto state = arena_get_state (&frame_arena);
+    defer (arena_set_state (&frame_arena, state));
+
+    int step = world->terrain_params.sample_step;
+    if (step <= 1 || Chunk_Size % step != 0)
+        step = Default_Terrain_Sample_Step;
+
+    bool bicubic = world->terrain_params.sampling == Terrain_Sampling_Bicubic;
+
+    // Bicubic interpolation needs an additional lattice point on each side
+    int border = bicubic ? 1 : 0;
+    int size = width / step + 1 + border * 2;
+    s64 count = size * size;
+
+    s64 lattice_start_x = start_x - border * step;
+    s64 lattice_start_z = start_z - border * step;
+
+    f64 *xs = mem_alloc_uninit (f64, count, frame_allocator);
+    f64 *zs = mem_alloc_uninit (f64, count, frame_allocator);
+    f64 *noise = mem_alloc_uninit (f64, count, frame_allocator);
+    auto lattice = mem_alloc_uninit (Terrain_Values, count, frame_allocator);
+
+    for_range (x, 0, size)
+    {
+        for_range (z, 0, size)
+        {
+            xs[x * size + z] = cast (f64) (lattice_start_x + x * step);
+            zs[x * size + z] = cast (f64) (lattice_start_z + z * step);
+        }
+    }
+
+    for_range (i, 0, 3)
+    {
+        perlin_fractal_noise_batch (world->terrain_params.noise[i], world->noise_offsets[i], world->noise_permutations[i], count, xs, zs, noise);
+        for_range (j, 0, count)
+            lattice[j].noise[i] = cast (f32) noise[j];
+    }
+
+    terrain_values_from_noise_batch (world, max_amplitude, count, lattice);
+
+    for_range (x, 0, width)
+    {
+        for_range (z, 0, width)
+        {
+            int lx = cast (int) x / step + border;
+            int lz = cast (int) z / step + border;
+            f32 tx = (x % step) / cast (f32) step;
+            f32 tz = (z % step) / cast (f32) step;
+
+            auto column = &values[x * width + z];
+
+            for_range (f, 0, Terrain_Values_Field_Count)
+            {
+                f32 result;
+                if (bicubic)
+                {
+                    f32 rows[4];
+                    for_range (i, 0, 4)
+                    {
+                        auto row = &lattice[(lx + i - 1) * size + lz];
+                        rows[i] = cubic_interpolate (
+                            *terrain_values_field (&row[-1], f),
+                            *terrain_values_field (&row[0], f),
+                            *terrain_values_field (&row[1], f),
+                            *terrain_values_field (&row[2], f),
+                            tz
+                        );
+                    }
+
+                    result = cubic_interpolate (rows[0], rows[1], rows[2], rows[3], tx);
+                }
+                else
+                {
+                    auto row0 = &lattice[lx * size + lz];
+                    auto row1 = &lattice[(lx + 1) * size + lz];
+                    f32 a = lerp (*terrain_values_field (&row0[0], f), *terrain_values_field (&row0[1], f), tz);
+                    f32 b = lerp (*terrain_values_field (&row1[0], f), *terrain_values_field (&row1[1], f), tz);
+                    result = lerp (a, b, tx);
+                }
+
+                *terrain_values_field (column, f) = result;
+            }
+        }
+    }
+}
+
+// Same as terrain_values_generate_coarse, with every column sampled
+void terrain_values_generate_full (World *world, const f32 max_amplitude[3], s64 start_x, s64 start_z, int width, Terrain_Values *values)
+{
+    auto state = arena_get_state (&frame_arena);
+    defer (arena_set_state (&frame_arena, state));
+
+    s64 count = cast (s64) width * width;
+
+    // The noise is evaluated for all the columns at once by the batched kernels,
+    // which give the same results as the per sample functions
+    f64 *noise = mem_alloc_uninit (f64, count, frame_allocator);
+    for_range (i, 0, 3)
+    {
+        perlin_fractal_noise_grid (world->terrain_params.noise[i], world->noise_offsets[i], world->noise_permutations[i],
+            cast (f64) start_x, cast (f64) start_z, width, width, noise);
+
+        for_range (j, 0, count)
+            values[j].noise[i] = cast (f32) noise[j];
+    }
+
+    terrain_values_from_noise_batch (world, max_amplitude, count, values);
+}
+
+void terrain_values_generate (World *world, s64 start_x, s64 start_z, int width, Terrain_Values *values)
+{
+    f32 max_amplitude[3];
+    terrain_values_max_amplitude (world, max_amplitude);
+
+    if (world->terrain_params.sampling != Terrain_Sampling_Full)
+        terrain_values_generate_coarse (world, max_amplitude, start_x, start_z, width, values);
+    else
+        terrain_values_generate_full (world, max_amplitude, start_x, start_z, width, values);
+}
+
+// Rounds towards negative infinity, so that negative coordinates map to the region below them
+inline
+s64 terrain_region_coordinate (s64 coordinate, s64 region_size)
+{
+    if (coordinate < 0)
+        return (coordinate + 1) / region_size - 1;
+
+    return coordinate / region_size;
+}
+
+void terrain_cache_clear (Terrain_Cache *cache)
+{
+    for_hash_map (it, cache->regions)
+    {
+        mem_free (*it.value, heap_allocator ());
+        hash_map_it_remove (&cache->regions, it);
+    }
+}
+
+void terrain_cache_evict_least_recently_used (Terrain_Cache *cache)
+{
+    Terrain_Region *oldest = null;
+    for_hash_map (it, cache->regions)
+    {
+        if (!oldest || (*it.value)->last_used < oldest->last_used)
+            oldest = *it.value;
+    }
+
+    if (!oldest)
+        return;
+
+    hash_map_remove (&cache->regions, {cast (s32) oldest->x, cast (s32) oldest->z});
+    mem_free (oldest, heap_allocator ());
+}
+
+// Returns the region, generating the terrain values of all its columns in one pass if it
+// is not in the cache. The pointer stays valid until the next call, since the region may
+// be evicted to make room for another one.
+Terrain_Region *terrain_cache_get_region (World *world, s64 region_x, s64 region_z)
+{
+    auto cache = &world->terrain_cache;
+    cache->use_counter += 1;
+
+    auto region_ptr = hash_map_get (&cache->regions, {cast (s32) region_x, cast (s32) region_z});
+    if (region_ptr)
+    {
+        (*region_ptr)->last_used = cache->use_counter;
+        cache->hit_count += 1;
+
+        return *region_ptr;
+    }
+
+    while (cache->regions.count >= Terrain_Cache_Max_Regions)
+        terrain_cache_evict_least_recently_used (cache);
+
+    auto region = mem_alloc_uninit (Terrain_Region, 1, heap_allocator ());
+    region->x = region_x;
+    region->z = region_z;
+    region->last_used = cache->use_counter;
+
+    terrain_values_generate (world, region_x * Terrain_Region_Width, region_z * Terrain_Region_Width, Terrain_Region_Width, region->values);
+    cache->generated_count += 1;
+
+    hash_map_insert (&cache->regions, {cast (s32) region_x, cast (s32) region_z}, region);
+
+    return region;
+}
+
+Terrain_Region *terrain_cache_get_region_of_chunk (World *world, s64 chunk_x, s64 chunk_z)
+{
+    return terrain_cache_get_region (world,
+        terrain_region_coordinate (chunk_x, Terrain_Region_Size),
+        terrain_region_coordinate (chunk_z, Terrain_Region_Size));
+}
+
+// Returns the region if it is in the cache, without generating it or marking it as used
+Terrain_Region *terrain_cache_find_region (Terrain_Cache *cache, s64 region_x, s64 region_z)
+{
+    auto region_ptr = hash_map_get (&cache->regions, {cast (s32) region_x, cast (s32) region_z});
+    if (!region_ptr)
+        return null;
+
+    return *region_ptr;
+}
+
+// Returns the values of the column if its region is in the cache, null otherwise
+const Terrain_Values *terrain_cache_find_column (Terrain_Cache *cache, s64 x, s64 z)
+{
+    auto region = terrain_cache_find_region (cache,
+        terrain_region_coordinate (x, Terrain_Region_Width),
+        terrain_region_coordinate (z, Terrain_Region_Width));
+    if (!region)
+        return null;
+
+    s64 local_x = x - region->x * Terrain_Region_Width;
+    s64 local_z = z - region->z * Terrain_Region_Width;
+
+    return &region->values[local_x * Terrain_Region_Width + local_z];
+}
+
+// Copies the values of the chunk at (local_x, local_z) in a square of values of the given
+// width, laid out like Terrain_Region.values, to the layout of a chunk
+void terrain_region_copy_chunk_values (const Terrain_Values *region_values, int width, s64 local_x, s64 local_z, Terrain_Values *chunk_values)
+{
+    for_range (x, 0, Chunk_Size)
+    {
+        auto src = &region_values[(local_x * Chunk_Size + x) * width + local_z * Chunk_Size];
+        memcpy (&chunk_values[x * Chunk_Size], src, sizeof (Terrain_Values) * Chunk_Size);
+    }
+}
+
+void chunk_generate_mine (World *world, Chunk *chunk)
+{
+    auto region = terrain_cache_get_region_of_chunk (world, chunk->x, chunk->z);
+
+    s64 local_x = chunk->x - region->x * Terrain_Region_Size;
+    s64 local_z = chunk->z - region->z * Terrain_Region_Size;
+    terrain_region_copy_chunk_values (region->values, Terrain_Region_Width, local_x, local_z, chunk->terrain_values);
+}
+
+// Smallest block height above 0 that is strictly above level, Chunk_Height if there is none.
+// Same as comparing each block height with level, including when level is NaN
+inline
+s64 chunk_first_block_above (f64 level)
+{
+    if (!(level < Chunk_Height - 1))
+        return Chunk_Height;
+    if (level < 1)
+        return 1;
+
+    return cast (s64) floor (level) + 1;
+}
+
+// Each column is made of runs of bedrock, stone, dirt and air. The ends of the runs are
+// computed for all columns, then the blocks are written layer by layer following the
+// y-major layout: layers where all the columns have the same type are filled at once.
+// Water is added by the surface stage.
+void chunk_fill_columns (Chunk *chunk)
+{
+    static const int Run_Count = 2;
+    static const Block_Type Run_Types[Run_Count + 1] = {Block_Type_Stone, Block_Type_Dirt, Block_Type_Air};
+    static const int Layer_Size = Chunk_Size * Chunk_Size;
+
+    s16 run_ends[Run_Count][Layer_Size];
+    s64 min_run_ends[Run_Count];
+    s64 max_run_ends[Run_Count];
+    for_range (r, 0, Run_Count)
+    {
+        min_run_ends[r] = Chunk_Height;
+        max_run_ends[r] = 0;
+    }
+
+    for_range (i, 0, Layer_Size)
+    {
+        f32 surface_level = chunk->terrain_values[i].surface_level;
+
+        s64 dirt_start = chunk_first_block_above (surface_level - Surface_Dirt_Height);
+        s64 air_start = chunk_first_block_above (surface_level);
+
+        run_ends[0][i] = cast (s16) dirt_start;
+        run_ends[1][i] = cast (s16) air_start;
+
+        for_range (r, 0, Run_Count)
+        {
+            min_run_ends[r] = min (min_run_ends[r], cast (s64) run_ends[r][i]);
+            max_run_ends[r] = max (max_run_ends[r], cast (s64) run_ends[r][i]);
+        }
+    }
+
+    Block_Type layer_types[Chunk_Height];
+
+    layer_types[0] = Block_Type_Bedrock;
+    memset (chunk->blocks, Block_Type_Bedrock, Layer_Size);
+
+    s64 y = 1;
+    while (y < Chunk_Height)
+    {
+        // Find the run all the columns are in for this layer, if any
+        int uniform_run = -1;
+        for_range (r, 0, Run_Count + 1)
+        {
+            s64 start = r > 0 ? max_run_ends[r - 1] : 1;
+            s64 end = r < Run_Count ? min_run_ends[r] : Chunk_Height;
+            if (y >= start && y < end)
+            {
+                uniform_run = cast (int) r;
+
+                break;
+            }
+        }
+
+        if (uniform_run >= 0)
+        {
+            s64 end = uniform_run < Run_Count ? min_run_ends[uniform_run] : Chunk_Height;
+            Block_Type type = Run_Types[uniform_run];
+
+            memset (chunk->blocks + y * Layer_Size, type, (end - y) * Layer_Size);
+            for_range (j, y, end)
+                layer_types[j] = type;
+
+            y = end;
+
+            continue;
+        }
+
+        auto layer = chunk->blocks + y * Layer_Size;
+        for_range (i, 0, Layer_Size)
+        {
+            Block_Type type = Block_Type_Air;
+            if (y < run_ends[1][i])
+                type = Block_Type_Dirt;
+            if (y < run_ends[0][i])
+                type = Block_Type_Stone;
+
+            layer[i].type = type;
+        }
+
+        layer_types[y] = Block_Type_Count;
+        y += 1;
+    }
+
+    for_range (s, 0, Chunk_Section_Count)
+    {
+        Block_Type type = layer_types[s * Chunk_Section_Height];
+        for_range (j, 1, Chunk_Section_Height)
+        {
+            if (layer_types[s * Chunk_Section_Height + j] != type)
+                type = Block_Type_Count;
+        }
+
+        chunk->section_types[s] = type;
+    }
+}
+
+// Recomputes the type of the sections in [first_section, end_section) from their blocks
+void chunk_update_section_types (Chunk *chunk, s64 first_section, s64 end_section)
+{
+    static const int Section_Size = Chunk_Section_Height * Chunk_Size * Chunk_Size;
+
+    for_range (s, first_section, end_section)
+    {
+        auto blocks = chunk->blocks + s * Section_Size;
+        Block_Type type = blocks[0].type;
+        for_range (i, 1, Section_Size)
+        {
+            if (blocks[i].type != type)
+            {
+                type = Block_Type_Count;
+
+                break;
+            }
+        }
+
+        chunk->section_types[s] = type;
+    }
+}
+
+// Carves the blocks filled by chunk_fill_columns with 3D noise. The normalized noise is clamped
+// to [-1, 1], so the density can only differ from the heightfield within density_amplitude of the
+// surface: the noise is only evaluated for the cells of that band, the other sections are left as
+// they are. The noise is sampled on a lattice of Density_Cell_Size x Density_Cell_Height cells,
+// shared with the neighboring chunks, and interpolated layer by layer.
+void chunk_generate_density (World *world, Chunk *chunk)
+{
+    static const int Layer_Size = Chunk_Size * Chunk_Size;
+    static const int Lattice_Size = Chunk_Size / Density_Cell_Size + 1;
+    static const int Lattice_Layer_Size = Lattice_Size * Lattice_Size;
+
+    auto params = &world->terrain_params;
+    f32 amplitude = params->density_amplitude;
+    if (!(amplitude > 0))
+        return;
+
+    f32 min_surface = F32_MAX;
+    f32 max_surface = -F32_MAX;
+    for_range (i, 0, Layer_Size)
+    {
+        min_surface = min (min_surface, chunk->terrain_values[i].surface_level);
+        max_surface = max (max_surface, chunk->terrain_values[i].surface_level);
+    }
+
+    s64 band_start = max (cast (s64) floorf (clamp (min_surface - amplitude, 0.0f, cast (f32) Chunk_Height)), cast (s64) 1);
+    s64 band_end = min (cast (s64) ceilf (clamp (max_surface + amplitude, 0.0f, cast (f32) Chunk_Height)) + 1, cast (s64) Chunk_Height);
+    if (band_start >= band_end)
+        return;
+
+    s64 first_cell = band_start / Density_Cell_Height;
+    s64 end_cell = (band_end + Density_Cell_Height - 1) / Density_Cell_Height;
+    s64 lattice_layer_count = end_cell - first_cell + 1;
+
+    auto state = arena_get_state (&frame_arena);
+    defer (arena_set_state (&frame_arena, state));
+
+    s64 count = lattice_layer_count * Lattice_Layer_Size;
+    f32 *xs = mem_alloc_uninit (f32, count, frame_allocator);
+    f32 *ys = mem_alloc_uninit (f32, count, frame_allocator);
+    f32 *zs = mem_alloc_uninit (f32, count, frame_allocator);
+    f32 *lattice = mem_alloc_uninit (f32, count, frame_allocator);
+    for_range (ly, 0, lattice_layer_count)
+    {
+        for_range (lx, 0, Lattice_Size)
+        {
+            for_range (lz, 0, Lattice_Size)
+            {
+                s64 index = ly * Lattice_Layer_Size + lx * Lattice_Size + lz;
+                xs[index] = cast (f32) (chunk->x * Chunk_Size + lx * Density_Cell_Size);
+                ys[index] = cast (f32) ((first_cell + ly) * Density_Cell_Height);
+                zs[index] = cast (f32) (chunk->z * Chunk_Size + lz * Density_Cell_Size);
+            }
+        }
+    }
+
+    perlin_fractal_noise_batch (params->density_noise, world->density_noise_offsets, world->density_noise_permutations, count, xs, ys, zs, lattice);
+
+    f32 scale = amplitude / cast (f32) perlin_fractal_max (params->density_noise.octaves, params->density_noise.persistance);
+    for_range (i, 0, count)
+        lattice[i] *= scale;
+
+    f32 surface_levels[Layer_Size];
+    for_range (i, 0, Layer_Size)
+        surface_levels[i] = chunk->terrain_values[i].surface_level;
+
+    for_range (y, band_start, band_end)
+    {
+        s64 ly = y / Density_Cell_Height - first_cell;
+        f32 ty = (y % Density_Cell_Height) / cast (f32) Density_Cell_Height;
+        f32 *below = lattice + ly * Lattice_Layer_Size;
+        f32 *above = below + Lattice_Layer_Size;
+
+        f32 plane[Lattice_Layer_Size];
+        for_range (i, 0, Lattice_Layer_Size)
+            plane[i] = lerp (below[i], above[i], ty);
+
+        f32 rows[Lattice_Size][Chunk_Size];
+        for_range (lx, 0, Lattice_Size)
+        {
+            for_range (z, 0, Chunk_Size)
+            {
+                s64 lz = z / Density_Cell_Size;
+                f32 tz = (z % Density_Cell_Size) / cast (f32) Density_Cell_Size;
+                rows[lx][z] = lerp (plane[lx * Lattice_Size + lz], plane[lx * Lattice_Size + lz + 1], tz);
+            }
+        }
+
+        f32 noise[Layer_Size];
+        for_range (x, 0, Chunk_Size)
+        {
+            s64 lx = x / Density_Cell_Size;
+            f32 tx = (x % Density_Cell_Size) / cast (f32) Density_Cell_Size;
+            for_range (z, 0, Chunk_Size)
+                noise[x * Chunk_Size + z] = lerp (rows[lx][z], rows[lx + 1][z], tx);
+        }
+
+        auto layer = chunk->blocks + y * Layer_Size;
+        for_range (i, 0, Layer_Size)
+        {
+            f32 density = surface_levels[i] - y + clamp (noise[i], -amplitude, amplitude);
+
+            Block_Type type;
+            if (density >= 0)
+                type = y > surface_levels[i] - Surface_Dirt_Height ? Block_Type_Dirt : Block_Type_Stone;
+            else
+                type = Block_Type_Air;
+
+            layer[i].type = type;
+        }
+    }
+
+    chunk_update_section_types (chunk, band_start / Chunk_Section_Height, (band_end - 1) / Chunk_Section_Height + 1);
+}
+
+// Block types each heightmap goes through
+static const u16 Heightmap_Ignored_Types[Heightmap_Count] = {
+    block_type_bit (Block_Type_Air),
+    cast (u16) (block_type_bit (Block_Type_Air) | block_type_bit (Block_Type_Water)),
+    cast (u16) (block_type_bit (Block_Type_Air) | block_type_bit (Block_Type_Water) | block_type_bit (Block_Type_Log) | block_type_bit (Block_Type_Leaves)),
+};
+
+// Computes all the heightmaps of the chunk, scanning the layers from the top of the highest
+// section that is not only air until all the columns of all the heightmaps are found
+void chunk_compute_heightmaps (Chunk *chunk)
+{
+    static const int Layer_Size = Chunk_Size * Chunk_Size;
+
+    s64 top = Chunk_Height - 1;
+    for (s64 s = Chunk_Section_Count - 1; s > 0 && chunk->section_types[s] == Block_Type_Air; s -= 1)
+        top = s * Chunk_Section_Height - 1;
+
+    memset (chunk->heightmaps, 0, sizeof (chunk->heightmaps));
+
+    s64 remaining[Heightmap_Count];
+    s64 total_remaining = 0;
+    for_range (t, 0, Heightmap_Count)
+    {
+        remaining[t] = Layer_Size;
+        total_remaining += Layer_Size;
+    }
+
+    for (s64 y = top; y >= 0 && total_remaining > 0; y -= 1)
+    {
+        auto layer = chunk->blocks + y * Layer_Size;
+        for_range (t, 0, Heightmap_Count)
+        {
+            if (remaining[t] == 0)
+                continue;
+
+            u16 ignored = Heightmap_Ignored_Types[t];
+            auto heights = chunk->heightmaps[t];
+            for_range (i, 0, Layer_Size)
+            {
+                if (heights[i] == 0 && !(ignored & block_type_bit (layer[i].type)))
+                {
+                    heights[i] = cast (u16) (y + 1);
+                    remaining[t] -= 1;
+                    total_remaining -= 1;
+                }
+            }
+        }
+    }
+}
+
+// Updates the heightmaps of the column after the block at (x, y, z) has changed. Only the
+// column is scanned, and only if the highest block of a heightmap has been removed.
+void chunk_update_heightmaps_at (Chunk *chunk, s64 x, s64 y, s64 z)
+{
+    s64 i = x * Chunk_Size + z;
+    u16 bit = block_type_bit (chunk->blocks[chunk_block_index (x, y, z)].type);
+
+    for_range (t, 0, Heightmap_Count)
+    {
+        u16 ignored = Heightmap_Ignored_Types[t];
+        u16 *height = &chunk->heightmaps[t][i];
+
+        if (!(ignored & bit))
+        {
+            if (y + 1 > *height)
+                *height = cast (u16) (y + 1);
+        }
+        else if (y + 1 == *height)
+        {
+            s64 h = y;
+            while (h > 0 && (ignored & block_type_bit (chunk->blocks[chunk_block_index (x, h - 1, z)].type)))
+                h -= 1;
+
+            *height = cast (u16) h;
+        }
+    }
+}
+
+// Returns the y of the block right above the highest block of the column that the heightmap
+// does not go through, or 0 if there is none. The coordinates are relative to the chunk.
+s64 chunk_get_height (Chunk *chunk, Heightmap_Type type, s64 x, s64 z)
+{
+    assert (x >= 0 && x < Chunk_Size && z >= 0 && z < Chunk_Size, "Bounds check failed (%lld, %lld)", x, z);
+
+    return chunk->heightmaps[type][x * Chunk_Size + z];
+}
+
+static const int Lake_Max_Depth = 6;
+static const int Lake_Min_Columns = 6;
+
+// Breadth first search of the columns water at the given level would cover, starting from
+// seed. It is bounded by the chunk: returns false as soon as the water reaches a column on
+// the border, since the basin could then spill over to the neighbours.
+bool lake_flood_columns (const s16 *heights, s64 seed, s64 level, bool *in_lake, s64 *column_count)
+{
+    static const int Layer_Size = Chunk_Size * Chunk_Size;
+
+    s16 queue[Layer_Size];
+    s64 head = 0;
+    s64 tail = 0;
+
+    memset (in_lake, 0, sizeof (bool) * Layer_Size);
+    in_lake[seed] = true;
+    queue[tail] = cast (s16) seed;
+    tail += 1;
+
+    while (head < tail)
+    {
+        s64 i = queue[head];
+        head += 1;
+
+        s64 x = i / Chunk_Size;
+        s64 z = i % Chunk_Size;
+        if (x == 0 || x == Chunk_Size - 1 || z == 0 || z == Chunk_Size - 1)
+            return false;
+
+        s64 neighbours[4] = {i - Chunk_Size, i + Chunk_Size, i - 1, i + 1};
+        for_range (n, 0, 4)
+        {
+            s64 j = neighbours[n];
+            if (in_lake[j] || heights[j] >= level)
+                continue;
+
+            in_lake[j] = true;
+            queue[tail] = cast (s16) j;
+            tail += 1;
+        }
+    }
+
+    *column_count = tail;
+
+    return true;
+}
+
+// Fills the columns below the water level with water, and the lowest basin above the water
+// level with a lake if it is enclosed in the chunk. The water surface of each column is
+// computed from the ground heights first, then the water is written layer by layer:
+// the layers that are water in all the columns are filled at once.
+void chunk_fill_water (World *world, Chunk *chunk)
+{
+    static const int Layer_Size = Chunk_Size * Chunk_Size;
+
+    s64 water_level = clamp (cast (s64) world->terrain_params.water_level, cast (s64) 0, cast (s64) Chunk_Height - 1);
+
+    // Height of the highest block of each column, before the water is added
+    s16 heights[Layer_Size];
+    for_range (i, 0, Layer_Size)
+        heights[i] = cast (s16) (chunk->heightmaps[Heightmap_World_Surface][i] - 1);
+
+    // Water surface of each column, at the ground for the columns without water
+    s16 levels[Layer_Size];
+    for_range (i, 0, Layer_Size)
+        levels[i] = cast (s16) max (cast (s64) heights[i], water_level);
+
+    // The lake starts from the lowest column above the sea that is not on the border,
+    // and is raised one block at a time for as long as the basin stays enclosed
+    s64 seed = -1;
+    for_range (x, 1, Chunk_Size - 1)
+    {
+        for_range (z, 1, Chunk_Size - 1)
+        {
+            s64 i = x * Chunk_Size + z;
+            if (heights[i] >= water_level && (seed < 0 || heights[i] < heights[seed]))
+                seed = i;
+        }
+    }
+
+    if (seed >= 0)
+    {
+        bool in_lake[Layer_Size];
+        bool best_lake[Layer_Size];
+        s64 best_level = -1;
+        s64 best_column_count = 0;
+
+        s64 max_level = min (cast (s64) heights[seed] + Lake_Max_Depth, cast (s64) Chunk_Height - 1);
+        for_range (level, heights[seed] + 1, max_level + 1)
+        {
+            s64 column_count;
+            if (!lake_flood_columns (heights, seed, level, in_lake, &column_count))
+                break;
+
+            best_level = level;
+            best_column_count = column_count;
+            memcpy (best_lake, in_lake, sizeof (in_lake));
+        }
+
+        if (best_level >= 0 && best_column_count >= Lake_Min_Columns)
+        {
+            for_range (i, 0, Layer_Size)
+            {
+                if (best_lake[i])
+                    levels[i] = cast (s16) best_level;
+            }
+        }
+    }
+
+    s64 min_height = Chunk_Height;
+    s64 max_height = 0;
+    s64 min_level = Chunk_Height;
+    s64 max_level = 0;
+    for_range (i, 0, Layer_Size)
+    {
+        min_height = min (min_height, cast (s64) heights[i]);
+        max_height = max (max_height, cast (s64) heights[i]);
+        min_level = min (min_level, cast (s64) levels[i]);
+        max_level = max (max_level, cast (s64) levels[i]);
+    }
+
+    s64 first_y = min_height + 1;
+    s64 end_y = max_level + 1;
+    if (first_y >= end_y)
+        return;
+
+    // Water is only seen by the world surface heightmap
+    for_range (i, 0, Layer_Size)
+    {
+        if (levels[i] > heights[i])
+            chunk->heightmaps[Heightmap_World_Surface][i] = cast (u16) (levels[i] + 1);
+    }
+
+    for_range (y, first_y, end_y)
+    {
+        auto layer = chunk->blocks + y * Layer_Size;
+
+        // All the columns have their ground below and their water surface above
+        if (y > max_height && y <= min_level)
+        {
+            memset (layer, Block_Type_Water, sizeof (Block) * Layer_Size);
+            continue;
+        }
+
+        for_range (i, 0, Layer_Size)
+        {
+            if (y > heights[i] && y <= levels[i])
+                layer[i].type = Block_Type_Water;
+        }
+    }
+
+    chunk_update_section_types (chunk, first_y / Chunk_Section_Height, (end_y - 1) / Chunk_Section_Height + 1);
+}
+
+static const Vec2l Chunk_Neighbour_Offsets[Chunk_Neighbour_Count] = {
+    {-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 1}, {1, -1}, {1, 0}, {1, 1},
+};
+
+// Index of the neighbour at the given offset in Chunk_Neighbour_Offsets and Chunk.outgoing_edits
+inline
+int chunk_neighbour_index (s64 offset_x, s64 offset_z)
+{
+    int index = cast (int) ((offset_x + 1) * 3 + offset_z + 1);
+
+    return index > 4 ? index - 1 : index;   // Skip the chunk itself
+}
+
+static_assert (Block_Type_Count <= 16, "Feature_Edit.replaceable_types has one bit per block type");
+static_assert (Feature_Max_Reach < Chunk_Size, "Features can only reach the direct neighbours of their chunk");
+
+struct Feature_Placement
+{
+    World *world;
+    Chunk *chunk;
+    u32 touched_sections;   // Sections of the chunk that have been edited
+};
+
+// Writes the block if it is in the chunk, or adds an edit for the neighbour it is in.
+// The coordinates are relative to the chunk.
+void feature_place_block (Feature_Placement *placement, s64 x, s64 y, s64 z, Block_Type type, u16 replaceable_types)
+{
+    if (y < 0 || y >= Chunk_Height)
+        return;
+
+    auto chunk = placement->chunk;
+
+    s64 offset_x = x < 0 ? -1 : (x >= Chunk_Size ? 1 : 0);
+    s64 offset_z = z < 0 ? -1 : (z >= Chunk_Size ? 1 : 0);
+    if (offset_x == 0 && offset_z == 0)
+    {
+        auto block = &chunk->blocks[chunk_block_index (x, y, z)];
+        if (replaceable_types & block_type_bit (block->type))
+        {
+            block->type = type;
+            chunk_update_heightmaps_at (chunk, x, y, z);
+            placement->touched_sections |= 1u << (y / Chunk_Section_Height);
+        }
+
+        return;
+    }
+
+    Feature_Edit edit;
+    edit.x = cast (s16) (x - offset_x * Chunk_Size);
+    edit.y = cast (s16) y;
+    edit.z = cast (s16) (z - offset_z * Chunk_Size);
+    edit.type = type;
+    edit.replaceable_types = replaceable_types;
+
+    array_push (&chunk->outgoing_edits[chunk_neighbour_index (offset_x, offset_z)], edit);
+}
+
+struct Ore_Params
+{
+    Block_Type type;
+    int veins_per_chunk;
+    int min_y, max_y;
+    int vein_size;
+};
+
+static const Ore_Params Ores[] = {
+    {Block_Type_Coal_Ore, 24, 1, 300, 12},
+    {Block_Type_Iron_Ore, 12, 1, 200, 8},
+};
+
+static const int Ore_Vein_Max_Extent = 3;
+static const int Ore_Max_Random_Numbers = 512;
+
+static const int Boulder_Chance = 6;    // One chunk in Boulder_Chance has a boulder
+static const int Tree_Attempts = 3;
+static const int Tree_Min_Height = 4;
+static const int Tree_Max_Height = 6;
+
+// Random stream salts of the features, so they do not use the same numbers
+static const u64 Feature_Salt_Ores     = 0x6f726573;
+static const u64 Feature_Salt_Boulders = 0x626f756c;
+static const u64 Feature_Salt_Trees    = 0x74726565;
+
+void feature_place_ores (Feature_Placement *placement)
+{
+    auto chunk = placement->chunk;
+
+    for_range (o, 0, cast (s64) array_size (Ores))
+    {
+        const auto &ore = Ores[o];
+        u64 key = chunk_random_key (placement->world, chunk->x, chunk->z, Feature_Salt_Ores + o);
+
+        // One number for the origin of each vein and one for each of its steps,
+        // drawn at once for the whole chunk
+        s64 numbers_per_vein = 1 + ore.vein_size;
+        u64 numbers[Ore_Max_Random_Numbers];
+        assert (ore.veins_per_chunk * numbers_per_vein <= Ore_Max_Random_Numbers);
+        random_fill (key, 0, ore.veins_per_chunk * numbers_per_vein, numbers);
+
+        u16 replaceable = block_type_bit (Block_Type_Stone);
+
+        for_range (v, 0, ore.veins_per_chunk)
+        {
+            u64 origin = numbers[v * numbers_per_vein];
+            s64 origin_x = origin & (Chunk_Size - 1);
+            s64 origin_z = (origin >> 4) & (Chunk_Size - 1);
+            s64 origin_y = ore.min_y + cast (s64) ((origin >> 32) % cast (u64) (ore.max_y - ore.min_y));
+
+            // Random walk around the origin, each step moves by one block along one axis
+            s64 x = origin_x, y = origin_y, z = origin_z;
+            for_range (s, 0, ore.vein_size)
+            {
+                feature_place_block (placement, x, y, z, ore.type, replaceable);
+
+                u64 step = numbers[v * numbers_per_vein + 1 + s];
+                s64 delta = (step & 1) ? 1 : -1;
+                switch ((step >> 1) % 3)
+                {
+                case 0: x = clamp (x + delta, origin_x - Ore_Vein_Max_Extent, origin_x + Ore_Vein_Max_Extent); break;
+                case 1: y = clamp (y + delta, origin_y - Ore_Vein_Max_Extent, origin_y + Ore_Vein_Max_Extent); break;
+                case 2: z = clamp (z + delta, origin_z - Ore_Vein_Max_Extent, origin_z + Ore_Vein_Max_Extent); break;
+                }
+            }
+        }
+    }
+}
+
+void feature_place_boulders (Feature_Placement *placement)
+{
+    auto chunk = placement->chunk;
+    auto world = placement->world;
+
+    Counter_RNG rng;
+    random_seed (&rng, chunk_random_key (world, chunk->x, chunk->z, Feature_Salt_Boulders));
+
+    if (random_rangei (&rng, 0, Boulder_Chance) != 0)
+        return;
+
+    s64 x = random_rangei (&rng, 0, Chunk_Size);
+    s64 z = random_rangei (&rng, 0, Chunk_Size);
+    s64 radius = random_rangei (&rng, 1, 3);
+
+    s64 height = chunk_get_height (chunk, Heightmap_World_Surface, x, z);
+    if (height == 0)
+        return;
+
+    s64 ground = height - 1;
+    if (chunk->blocks[chunk_block_index (x, ground, z)].type != Block_Type_Dirt)
+        return;
+
+    // Half buried in the ground
+    s64 center_y = ground + radius / 2;
+    u16 replaceable = block_type_bit (Block_Type_Air) | block_type_bit (Block_Type_Dirt);
+
+    for_range (dx, -radius, radius + 1)
+    {
+        for_range (dy, -radius, radius + 1)
+        {
+            for_range (dz, -radius, radius + 1)
+            {
+                if (dx * dx + dy * dy + dz * dz > radius * radius + 1)
+                    continue;
+
+                feature_place_block (placement, x + dx, center_y + dy, z + dz, Block_Type_Stone, replaceable);
+            }
+        }
+    }
+}
+
+void feature_place_trees (Feature_Placement *placement)
+{
+    auto chunk = placement->chunk;
+    auto world = placement->world;
+
+    Counter_RNG rng;
+    random_seed (&rng, chunk_random_key (world, chunk->x, chunk->z, Feature_Salt_Trees));
+
+    u16 log_replaceable = block_type_bit (Block_Type_Air) | block_type_bit (Block_Type_Leaves);
+    u16 leaves_replaceable = block_type_bit (Block_Type_Air);
+
+    for_range (t, 0, Tree_Attempts)
+    {
+        // Always draw the same amount of numbers, so that the attempts do not depend on each other
+        s64 x = random_rangei (&rng, 0, Chunk_Size);
+        s64 z = random_rangei (&rng, 0, Chunk_Size);
+        s64 height = random_rangei (&rng, Tree_Min_Height, Tree_Max_Height + 1);
+        u64 corners = random_get (&rng);
+
+        s64 column_height = chunk_get_height (chunk, Heightmap_World_Surface, x, z);
+        if (column_height == 0)
+            continue;
+
+        s64 ground = column_height - 1;
+        if (chunk->blocks[chunk_block_index (x, ground, z)].type != Block_Type_Dirt)
+            continue;
+        if (ground + height + 2 >= Chunk_Height)
+            continue;
+
+        s64 top = ground + height;
+
+        for_range (y, ground + 1, top + 1)
+            feature_place_block (placement, x, y, z, Block_Type_Log, log_replaceable);
+
+        // Two wide layers below the top, then a narrow one at the top and a cross above it
+        for_range (y, top - 2, top + 2)
+        {
+            s64 radius = y < top ? 2 : 1;
+            for_range (dx, -radius, radius + 1)
+            {
+                for_range (dz, -radius, radius + 1)
+                {
+                    bool is_corner = (dx == -radius || dx == radius) && (dz == -radius || dz == radius);
+                    if (is_corner)
+                    {
+                        // Randomly cut the corners of the wide layers, remove them on the narrow ones
+                        if (radius == 1 || (corners & 1))
+                        {
+                            corners >>= 1;
+                            continue;
+                        }
+
+                        corners >>= 1;
+                    }
+
+                    if (y > top && (dx != 0 && dz != 0))
+                        continue;
+
+                    feature_place_block (placement, x + dx, y, z + dz, Block_Type_Leaves, leaves_replaceable);
+                }
+            }
+        }
+    }
+}
+
+void chunk_update_touched_section_types (Chunk *chunk, u32 touched_sections)
+{
+    for_range (s, 0, Chunk_Section_Count)
+    {
+        if (touched_sections & (1u << s))
+            chunk_update_section_types (chunk, s, s + 1);
+    }
+}
+
+// Places the ores, boulders and trees that start in the chunk. The placement only depends on
+// the blocks of the chunk and its random key, so chunks can place their features in any order
+// and on any thread. The blocks falling in the neighbours are written to Chunk.outgoing_edits.
+void chunk_place_features (World *world, Chunk *chunk)
+{
+    for_range (i, 0, Chunk_Neighbour_Count)
+        array_clear (&chunk->outgoing_edits[i]);
+
+    Feature_Placement placement = {};
+    placement.world = world;
+    placement.chunk = chunk;
+
+    feature_place_ores (&placement);
+    feature_place_boulders (&placement);
+    feature_place_trees (&placement);
+
+    chunk_update_touched_section_types (chunk, placement.touched_sections);
+}
+
+// Applies the edits the neighbours have for the chunk, in the order of Chunk_Neighbour_Offsets,
+// so the result does not depend on the order the neighbours were generated in. All the
+// neighbours must have placed their features. They are only read, so the chunks of different
+// threads can do this at the same time as long as the neighbours are done with their features.
+void chunk_apply_feature_edits (Chunk *chunk, Chunk *const neighbours[Chunk_Neighbour_Count])
+{
+    u32 touched_sections = 0;
+
+    for_range (i, 0, Chunk_Neighbour_Count)
+    {
+        auto neighbour = neighbours[i];
+        if (!neighbour)
+            continue;
+
+        assert (neighbour->stage >= Chunk_Stage_Features);
+
+        auto offset = Chunk_Neighbour_Offsets[i];
+        auto edits = &neighbour->outgoing_edits[chunk_neighbour_index (-offset.x, -offset.y)];
+        for_array (j, *edits)
+        {
+            const auto &edit = edits->data[j];
+
+            auto block = &chunk->blocks[chunk_block_index (edit.x, edit.y, edit.z)];
+            if (edit.replaceable_types & block_type_bit (block->type))
+            {
+                block->type = edit.type;
+                chunk_update_heightmaps_at (chunk, edit.x, edit.y, edit.z);
+                touched_sections |= 1u << (edit.y / Chunk_Section_Height);
+            }
+        }
+    }
+
+    chunk_update_touched_section_types (chunk, touched_sections);
+}
+
+// The neighbours are found through the links between the chunks, so this works for the chunks
+// of the world as well as for the grids of world_pregenerate
+void chunk_apply_neighbour_feature_edits (Chunk *chunk)
+{
+    Chunk *neighbours[Chunk_Neighbour_Count];
+    for_range (i, 0, Chunk_Neighbour_Count)
+    {
+        s64 x = Chunk_Neighbour_Offsets[i].x * Chunk_Size;
+        s64 z = Chunk_Neighbour_Offsets[i].y * Chunk_Size;
+        neighbours[i] = chunk_get_at_relative_coordinates (chunk, &x, &z);
+    }
+
+    chunk_apply_feature_edits (chunk, neighbours);
+}
+
+// Stage the 8 neighbours need to be at before a chunk can go to the given stage
+Chunk_Stage chunk_stage_neighbour_requirement (Chunk_Stage stage)
+{
+    switch (stage)
+    {
+    case Chunk_Stage_Light:    return Chunk_Stage_Features;  // Applies the feature edits of the neighbours
+    case Chunk_Stage_Mesh:     return Chunk_Stage_Light;     // Faces on the borders depend on the neighbours
+    default:                   return Chunk_Stage_Empty;
+    }
+}
+
+// Checks the 8 neighbours, like world_advance_chunk does. The diagonal neighbours are
+// found through the cardinal ones
+bool chunk_neighbours_reached_stage (Chunk *chunk, Chunk_Stage stage)
+{
+    for_range (i, 0, Chunk_Neighbour_Count)
+    {
+        s64 x = Chunk_Neighbour_Offsets[i].x * Chunk_Size;
+        s64 z = Chunk_Neighbour_Offsets[i].y * Chunk_Size;
+
+        auto neighbour = chunk_get_at_relative_coordinates (chunk, &x, &z);
+        if (!neighbour || neighbour->stage < stage)
+            return false;
+    }
+
+    return true;
+}
+
+void chunk_run_stage (World *world, Chunk *chunk, Chunk_Stage stage)
+{
+    switch (stage)
+    {
+    case Chunk_Stage_Terrain_Values:
+        // chunk_generate_cubiome (chunk, sampler);
+        chunk_generate_mine (world, chunk);
+        break;
+
+    case Chunk_Stage_Blocks:
+        chunk_fill_columns (chunk);
+
+        if (world->terrain_params.density_terrain)
+            chunk_generate_density (world, chunk);
+
+        chunk_compute_heightmaps (chunk);
+        break;
+
+    // Dirt is placed along with the blocks for now
+    case Chunk_Stage_Surface:
+        chunk_fill_water (world, chunk);
+        break;
+
+    case Chunk_Stage_Features:
+        chunk_place_features (world, chunk);
+        break;
+
+    // There is no lighting yet, the stage only completes the features of the neighbours
+    case Chunk_Stage_Light:
+        chunk_apply_neighbour_feature_edits (chunk);
+        break;
+
+    default:
+        assert (false, "Invalid chunk stage %d", cast (int) stage);
+        break;
+    }
+
+    chunk->stage = stage;
+}
+
+// Runs the stages of the chunk up to target, after advancing the neighbours as required.
+// Meshing is done by world_draw_chunks, so a target of Chunk_Stage_Mesh stops once the
+// chunk and its neighbours are ready for it. Starting a new chunk costs one unit of the
+// budget, plus Terrain_Region_Generation_Cost if its terrain region has to be generated.
+// The budget is unlimited if null. Returns false if the budget ran out first.
+bool world_advance_chunk (World *world, Chunk *chunk, Chunk_Stage target, int *budget)
+{
+    while (chunk->stage < target)
+    {
+        auto next = cast (Chunk_Stage) (chunk->stage + 1);
+
+        auto required = chunk_stage_neighbour_requirement (next);
+        if (required != Chunk_Stage_Empty)
+        {
+            bool neighbours_ready = true;
+            // The diagonal neighbours are needed as well, since features can cross the corners
+            for_range (i, 0, Chunk_Neighbour_Count)
+            {
+                s64 x = chunk->x + Chunk_Neighbour_Offsets[i].x;
+                s64 z = chunk->z + Chunk_Neighbour_Offsets[i].y;
+
+                auto neighbour = world_get_chunk (world, x, z);
+                if (!neighbour)
+                {
+                    if (budget && *budget <= 0)
+                    {
+                        neighbours_ready = false;
+                        continue;
+                    }
+
+                    neighbour = world_create_chunk (world, x, z);
+                }
+
+                if (!world_advance_chunk (world, neighbour, required, budget))
+                    neighbours_ready = false;
+            }
+
+            if (!neighbours_ready)
+                return false;
+        }
+
+        if (next == Chunk_Stage_Mesh)
+            break;
+
+        if (next == Chunk_Stage_Terrain_Values && budget)
+        {
+            if (*budget <= 0)
+                return false;
+
+            *budget -= 1;
+
+            // The chunk generates its whole region if it is not cached. The budget can become
+            // negative, in which case the caller carries the debt over to the next frames
+            s64 region_x = terrain_region_coordinate (chunk->x, Terrain_Region_Size);
+            s64 region_z = terrain_region_coordinate (chunk->z, Terrain_Region_Size);
+            if (!terrain_cache_find_region (&world->terrain_cache, region_x, region_z))
+                *budget -= Terrain_Region_Generation_Cost;
+        }
+
+        chunk_run_stage (world, chunk, next);
+    }
+
+    return true;
+}
+
+// Generates the chunk and its neighbours so that it can be meshed
+void chunk_generate (World *world, Chunk *chunk)
+{
+    world_advance_chunk (world, chunk, Chunk_Stage_Mesh);
+}
+
+void push_block (Array<Vertex> *vertices, u8 id, const Vec3f &position, Block_Face_Flags visible_faces, f32 size = 1)
+{
+    f32 h = size * 0.5f;
+
+    if (visible_faces & Block_Face_Flag_East)
+    {
+        auto v = array_push (vertices, {position, Block_Face_East, id, Block_Corner_Bottom_Left});
+        v->position += {h, -h, -h};
+
+        v = array_push (vertices, {position, Block_Face_East, id, Block_Corner_Top_Left});
+        v->position += {h, h, -h};
+
+        v = array_push (vertices, {position, Block_Face_East, id, Block_Corner_Top_Right});
+        v->position += {h, h, h};
+
+        v = array_push (vertices, {position, Block_Face_East, id, Block_Corner_Bottom_Left});
+        v->position += {h, -h, -h};
+
+        v = array_push (vertices, {position, Block_Face_East, id, Block_Corner_Top_Right});
+        v->position += {h, h, h};
+
+        v = array_push (vertices, {position, Block_Face_East, id, Block_Corner_Bottom_Right});
+        v->position += {h, -h, h};
+    }
+
+    if (visible_faces & Block_Face_Flag_West)
+    {
+        auto v = array_push (vertices, {position, Block_Face_West, id, Block_Corner_Bottom_Right});
+        v->position += {-h, -h, -h};
+
+        v = array_push (vertices, {position, Block_Face_West, id, Block_Corner_Top_Left});
+        v->position += {-h, h, h};
+
+        v = array_push (vertices, {position, Block_Face_West, id, Block_Corner_Top_Right});
+        v->position += {-h, h, -h};
+
+        v = array_push (vertices, {position, Block_Face_West, id, Block_Corner_Bottom_Right});
+        v->position += {-h, -h, -h};
+
+        v = array_push (vertices, {position, Block_Face_West, id, Block_Corner_Bottom_Left});
+        v->position += {-h, -h, h};
+
+        v = array_push (vertices, {position, Block_Face_West, id, Block_Corner_Top_Left});
+        v->position += {-h, h, h};
+    }
+
+    if (visible_faces & Block_Face_Flag_Above)
+    {
+        auto v = array_push (vertices, {position, Block_Face_Above, id, Block_Corner_Bottom_Left});
+        v->position += {-h, h, -h};
+
+        v = array_push (vertices, {position, Block_Face_Above, id, Block_Corner_Top_Right});
+        v->position += {h, h, h};
+
+        v = array_push (vertices, {position, Block_Face_Above, id, Block_Corner_Bottom_Right});
+        v->position += {h, h, -h};
+
+        v = array_push (vertices, {position, Block_Face_Above, id, Block_Corner_Bottom_Left});
+        v->position += {-h, h, -h};
+
+        v = array_push (vertices, {position, Block_Face_Above, id, Block_Corner_Top_Left});
+        v->position += {-h, h, h};
+
+        v = array_push (vertices, {position, Block_Face_Above, id, Block_Corner_Top_Right});
+        v->position += {h, h, h};
+    }
+
+    if (visible_faces & Block_Face_Flag_Below)
+    {
+        auto v = array_push (vertices, {position, Block_Face_Below, id, Block_Corner_Top_Left});
+        v->position += {-h, -h, -h};
+
+        v = array_push (vertices, {position, Block_Face_Below, id, Block_Corner_Top_Right});
+        v->position += {h, -h, -h};
+
+        v = array_push (vertices, {position, Block_Face_Below, id, Block_Corner_Bottom_Right});
+        v->position += {h, -h, h};
+
+        v = array_push (vertices, {position, Block_Face_Below, id, Block_Corner_Top_Left});
+        v->position += {-h, -h, -h};
+
+        v = array_push (vertices, {position, Block_Face_Below, id, Block_Corner_Bottom_Right});
+        v->position += {h, -h, h};
+
+        v = array_push (vertices, {position, Block_Face_Below, id, Block_Corner_Bottom_Left});
+        v->position += {-h, -h, h};
+    }
+
+    if (visible_faces & Block_Face_Flag_North)
+    {
+        auto v = array_push (vertices, {position, Block_Face_North, id, Block_Corner_Bottom_Right});
+        v->position += {-h, -h, h};
+
+        v = array_push (vertices, {position, Block_Face_North, id, Block_Corner_Bottom_Left});
+        v->position += {h, -h, h};
+
+        v = array_push (vertices, {position, Block_Face_North, id, Block_Corner_Top_Left});
+        v->position += {h, h, h};
+
+        v = array_push (vertices, {position, Block_Face_North, id, Block_Corner_Bottom_Right});
+        v->position += {-h, -h, h};
+
+        v = array_push (vertices, {position, Block_Face_North, id, Block_Corner_Top_Left});
+        v->position += {h, h, h};
+
+        v = array_push (vertices, {position, Block_Face_North, id, Block_Corner_Top_Right});
+        v->position += {-h, h, h};
+    }
+
+    if (visible_faces & Block_Face_Flag_South)
+    {
+        auto v = array_push (vertices, {position, Block_Face_South, id, Block_Corner_Bottom_Left});
+        v->position += {-h, -h, -h};
+
+        v = array_push (vertices, {position, Block_Face_South, id, Block_Corner_Top_Right});
+        v->position += {h, h, -h};
+
+        v = array_push (vertices, {position, Block_Face_South, id, Block_Corner_Bottom_Right});
+        v->position += {h, -h, -h};
+
+        v = array_push (vertices, {position, Block_Face_South, id, Block_Corner_Bottom_Left});
+        v->position += {-h, -h, -h};
+
+        v = array_push (vertices, {position, Block_Face_South, id, Block_Corner_Top_Left});
+        v->position += {-h, h, -h};
+
+        v = array_push (vertices, {position, Block_Face_South, id, Block_Corner_Top_Right});
+        v->position += {h, h, -h};
+    }
+}
+
+inline
+bool block_is_of_mesh_type (Block_Type block, Chunk_Mesh_Type mesh_type)
+{
+    switch (mesh_type)
+    {
+    case Chunk_Mesh_Solid:
+        return block != Block_Type_Water && block != Block_Type_Air;
+    case Chunk_Mesh_Water:
+        return block == Block_Type_Water;
+    default:
+        return false;
+    }
+}
+
+int chunk_lod_for_distance (f32 distance_in_chunks)
+{
+    int lod = cast (int) (distance_in_chunks / max (g_lod_distance, 1));
+
+    return clamp (lod, 0, Chunk_Max_Lod);
+}
+
+// Blocks of a chunk downsampled into cells of step^3 blocks, plus a border
+// of one cell on the X and Z axes taken from the neighbouring chunks
+struct Chunk_Lod_Grid
+{
+    int step;
+    int size;
+    int height;
+    int first_layer;    // Only the layers of cells in [first_layer, end_layer) are built
+    int end_layer;
+    Block_Type *cells;
+};
+
+inline
+Block_Type lod_grid_get (Chunk_Lod_Grid *grid, s64 x, s64 y, s64 z)
+{
+    if (y < 0 || y >= grid->height)
+        return Block_Type_Air;
+
+    assert (y >= grid->first_layer && y < grid->end_layer, "Layer %lld of the grid was not built", y);
+
+    return grid->cells[(y - grid->first_layer) * (grid->size + 2) * (grid->size + 2) + (x + 1) * (grid->size + 2) + (z + 1)];
+}
+
+inline
+void lod_grid_set (Chunk_Lod_Grid *grid, s64 x, s64 y, s64 z, Block_Type type)
+{
+    grid->cells[(y - grid->first_layer) * (grid->size + 2) * (grid->size + 2) + (x + 1) * (grid->size + 2) + (z + 1)] = type;
+}
+
+// Returns the most common block type of the cell, preferring non air blocks on ties
+Block_Type chunk_downsample_cell (Chunk *chunk, int step, s64 x, s64 y, s64 z)
+{
+    if (step == 1)
+        return chunk->blocks[chunk_block_index (x, y, z)].type;
+
+    int counts[Block_Type_Count] = {};
+    for_range (j, y, y + step)
+    {
+        for_range (i, x, x + step)
+        {
+            for_range (k, z, z + step)
+                counts[chunk->blocks[chunk_block_index (i, j, k)].type] += 1;
+        }
+    }
+
+    int result = Block_Type_Air;
+    for_range (type, Block_Type_Air + 1, Block_Type_Count)
+    {
+        if (counts[type] >= counts[result])
+            result = cast (int) type;
+    }
+
+    return cast (Block_Type) result;
+}
+
+// Builds the layers of cells in [first_layer, end_layer) of the grid
+void chunk_build_lod_grid (Chunk *chunk, int lod, int first_layer, int end_layer, Chunk_Lod_Grid *grid, Allocator allocator)
+{
+    grid->step = 1 << lod;
+    grid->size = Chunk_Size / grid->step;
+    grid->height = Chunk_Height / grid->step;
+    grid->first_layer = first_layer;
+    grid->end_layer = end_layer;
+    // Cells of unloaded neighbours are left as air
+    grid->cells = mem_alloc_typed (Block_Type, (grid->size + 2) * (grid->size + 2) * (end_layer - first_layer), allocator);
+
+    int step = grid->step;
+    for_range (y, first_layer, end_layer)
+    {
+        for_range (x, 0, grid->size)
+        {
+            for_range (z, 0, grid->size)
+                lod_grid_set (grid, x, y, z, chunk_downsample_cell (chunk, step, x * step, y * step, z * step));
+        }
+
+        for_range (i, 0, grid->size)
+        {
+            if (chunk->east)
+                lod_grid_set (grid, grid->size, y, i, chunk_downsample_cell (chunk->east, step, 0, y * step, i * step));
+            if (chunk->west)
+                lod_grid_set (grid, -1, y, i, chunk_downsample_cell (chunk->west, step, Chunk_Size - step, y * step, i * step));
+            if (chunk->north)
+                lod_grid_set (grid, i, y, grid->size, chunk_downsample_cell (chunk->north, step, i * step, y * step, 0));
+            if (chunk->south)
+                lod_grid_set (grid, i, y, -1, chunk_downsample_cell (chunk->south, step, i * step, y * step, Chunk_Size - step));
+        }
+    }
+}
+
+// Borders between chunks of different LODs do not line up, so faces on the border are
+// kept down to this depth below the surface of the column to hide the cracks
+static const int Lod_Skirt_Depth = 8;
+
+// Only borders with a neighbour of a different LOD have skirts, neighbours of the same
+// LOD line up. Returns true if any side of the chunk has skirts
+bool chunk_get_skirts (Chunk *chunk, bool skirts[6])
+{
+    memset (skirts, 0, sizeof (bool) * 6);
+    skirts[Block_Face_East]  = chunk->east  && chunk->mesh_lod != chunk->east->mesh_lod;
+    skirts[Block_Face_West]  = chunk->west  && chunk->mesh_lod != chunk->west->mesh_lod;
+    skirts[Block_Face_North] = chunk->north && chunk->mesh_lod != chunk->north->mesh_lod;
+    skirts[Block_Face_South] = chunk->south && chunk->mesh_lod != chunk->south->mesh_lod;
+
+    return skirts[Block_Face_East] || skirts[Block_Face_West] || skirts[Block_Face_North] || skirts[Block_Face_South];
+}
+
+// Appends the vertices of the sections in [first_section, end_section) to vertices, section
+// by section. section_offsets[s] is set to the index of the first vertex of section s, for s
+// in [first_section, end_section]. Skirts depend on the whole column, so they require the grid
+// to have all of its layers.
+void chunk_generate_mesh_data (Chunk *chunk, Chunk_Lod_Grid *grid, const bool skirts[6], s64 first_section, s64 end_section, Array<Vertex> *vertices, Chunk_Mesh_Type type, u32 *section_offsets)
+{
+    int step = grid->step;
+    int section_cells = Chunk_Section_Height / step;
+    int skirt_cells = max (Lod_Skirt_Depth / step, 1);
+    f32 cell_center = (step - 1) * 0.5f;
+
+    bool has_skirts = skirts[Block_Face_East] || skirts[Block_Face_West] || skirts[Block_Face_North] || skirts[Block_Face_South];
+
+    s64 column_tops[Chunk_Size * Chunk_Size];
+    if (has_skirts)
+    {
+        assert (grid->first_layer == 0 && grid->end_layer == grid->height, "Skirts need all the layers of the grid");
+
+        for_range (x, 0, grid->size)
+        {
+            for_range (z, 0, grid->size)
+            {
+                s64 y = grid->height - 1;
+                while (y >= 0 && !block_is_of_mesh_type (lod_grid_get (grid, x, y, z), type))
+                    y -= 1;
+
+                column_tops[x * grid->size + z] = y;
+            }
+        }
+    }
+
+    Vec3f position = {cast (f32) chunk->x * Chunk_Size, 0, cast (f32) chunk->z * Chunk_Size};
+    for_range (s, first_section, end_section)
+    {
+        section_offsets[s] = cast (u32) vertices->count;
+
+        for_range (y, s * section_cells, (s + 1) * section_cells)
+        {
+            for_range (x, 0, grid->size)
+            {
+                for_range (z, 0, grid->size)
+                {
+                    auto block = lod_grid_get (grid, x, y, z);
+                    if (!block_is_of_mesh_type (block, type))
+                        continue;
+
+                    Block_Face_Flags visible_faces = 0;
+                    if (!block_is_of_mesh_type (lod_grid_get (grid, x + 1, y, z), type))
+                        visible_faces |= Block_Face_Flag_East;
+                    if (!block_is_of_mesh_type (lod_grid_get (grid, x - 1, y, z), type))
+                        visible_faces |= Block_Face_Flag_West;
+                    if (!block_is_of_mesh_type (lod_grid_get (grid, x, y + 1, z), type))
+                        visible_faces |= Block_Face_Flag_Above;
+                    if (!block_is_of_mesh_type (lod_grid_get (grid, x, y - 1, z), type))
+                        visible_faces |= Block_Face_Flag_Below;
+                    if (!block_is_of_mesh_type (lod_grid_get (grid, x, y, z + 1), type))
+                        visible_faces |= Block_Face_Flag_North;
+                    if (!block_is_of_mesh_type (lod_grid_get (grid, x, y, z - 1), type))
+                        visible_faces |= Block_Face_Flag_South;
+
+                    bool in_skirt_range = has_skirts
+                        && (x == 0 || z == 0 || x == grid->size - 1 || z == grid->size - 1)
+                        && column_tops[x * grid->size + z] - y < skirt_cells;
+                    if (in_skirt_range)
+                    {
+                        if (x == grid->size - 1 && skirts[Block_Face_East])
+                            visible_faces |= Block_Face_Flag_East;
+                        if (x == 0 && skirts[Block_Face_West])
+                            visible_faces |= Block_Face_Flag_West;
+                        if (z == grid->size - 1 && skirts[Block_Face_North])
+                            visible_faces |= Block_Face_Flag_North;
+                        if (z == 0 && skirts[Block_Face_South])
+                            visible_faces |= Block_Face_Flag_South;
+                    }
+
+                    Vec3f cell_position = {cast (f32) (x * step) + cell_center, cast (f32) (y * step) + cell_center, cast (f32) (z * step) + cell_center};
+                    push_block (vertices, cast (u8) block, position + cell_position, visible_faces, cast (f32) step);
+                }
+            }
+        }
+    }
+
+    section_offsets[end_section] = cast (u32) vertices->count;
+}
+
+// Faces are made of 6 vertices, two of which are duplicated on the diagonal,
+// so the average of the 6 positions gives the center of the face
+inline
+Vec3f mesh_face_center (const Vertex *face_vertices)
+{
+    Vec3f center = {};
+    for_range (k, 0, 6)
+        center += face_vertices[k].position;
+
+    return center / 6.0f;
+}
+
+void chunk_generate_mesh_data (Chunk *chunk)
+{
+    if (!chunk->is_dirty)
+        return;
+    defer (chunk->is_dirty = false);
+
+    // Meshing the whole chunk covers the dirty sections as well
+    chunk->dirty_sections = 0;
+
+    auto state = arena_get_state (&frame_arena);
+    defer (arena_set_state (&frame_arena, state));
+
+    Chunk_Lod_Grid grid;
+    chunk_build_lod_grid (chunk, chunk->mesh_lod, 0, Chunk_Height >> chunk->mesh_lod, &grid, frame_allocator);
+
+    bool skirts[6];
+    chunk_get_skirts (chunk, skirts);
+
+    Array<Vertex> vertices;
+    array_init (&vertices, frame_allocator, 12000);
+
+    chunk->total_vertex_count = 0;
+    chunk->mesh_y_range = {F32_MAX, -F32_MAX};
+    for_range (i, 0, Chunk_Mesh_Count)
+    {
+        chunk_generate_mesh_data (chunk, &grid, skirts, 0, Chunk_Section_Count, &vertices, cast (Chunk_Mesh_Type) i, chunk->section_vertex_offsets[i]);
+        chunk->vertex_counts[i] = vertices.count;
+        chunk->vbo_capacities[i] = vertices.count;
+        chunk->total_vertex_count += vertices.count;
+
+        for_array (j, vertices)
+        {
+            chunk->mesh_y_range.x = min (chunk->mesh_y_range.x, vertices[j].position.y);
+            chunk->mesh_y_range.y = max (chunk->mesh_y_range.y, vertices[j].position.y);
+        }
+
+        if (i == Chunk_Mesh_Water)
+        {
+            array_clear (&chunk->water_face_centers);
+            for (s64 j = 0; j + 5 < vertices.count; j += 6)
+                array_push (&chunk->water_face_centers, mesh_face_center (vertices.data + j));
+
+            chunk->water_sort_valid = false;
+        }
+
+        glBindVertexArray (chunk->opengl_is_stupid_vaos[i]);
+        glBindBuffer (GL_ARRAY_BUFFER, chunk->gl_vbos[i]);
+
+        glBufferData (GL_ARRAY_BUFFER, sizeof (Vertex) * vertices.count, vertices.data, GL_DYNAMIC_DRAW);
+
+        glBindVertexArray (0);
+        glBindBuffer (GL_ARRAY_BUFFER, 0);
+
+        array_clear (&vertices);
+    }
+}
+
+// Holds the vertices that move in a vertex buffer while the vertices of some sections are replaced
+static GLuint g_mesh_scratch_buffer;
+static s64 g_mesh_scratch_capacity;     // In vertices
+
+// Replaces the vertices of the sections in [first_section, end_section) of a mesh by the given
+// ones, whose section_offsets start at 0 for first_section. The vertices of the following sections
+// are moved on the GPU, and the buffer only gets reallocated when it has to grow.
+void chunk_replace_section_vertices (Chunk *chunk, Chunk_Mesh_Type type, s64 first_section, s64 end_section, Array<Vertex> vertices, const u32 *section_offsets)
+{
+    u32 *offsets = chunk->section_vertex_offsets[type];
+    s64 start = offsets[first_section];
+    s64 old_end = offsets[end_section];
+    s64 old_count = offsets[Chunk_Section_Count];
+    s64 new_count = old_count - (old_end - start) + vertices.count;
+
+    glBindBuffer (GL_ARRAY_BUFFER, chunk->gl_vbos[type]);
+
+    if (vertices.count != old_end - start)
+    {
+        // The vertices after the range are saved before being overwritten, and so are
+        // the vertices before the range if the buffer gets reallocated
+        bool grow = new_count > chunk->vbo_capacities[type];
+        s64 saved_start = grow ? 0 : old_end;
+        s64 saved_count = old_count - saved_start;
+
+        if (!g_mesh_scratch_buffer)
+            glGenBuffers (1, &g_mesh_scratch_buffer);
 
-        v = array_push (vertices, {position, Block_Face_South, id, Block_Corner_Top_Right});
-        v->position += {0.5, 0.5, -0.5};
+        glBindBuffer (GL_COPY_WRITE_BUFFER, g_mesh_scratch_buffer);
+        if (saved_count > g_mesh_scratch_capacity)
+        {
+            g_mesh_scratch_capacity = max (saved_count, g_mesh_scratch_capacity * 2);
+            glBufferData (GL_COPY_WRITE_BUFFER, sizeof (Vertex) * g_mesh_scratch_capacity, null, GL_DYNAMIC_COPY);
+        }
 
-        v = array_push (vertices, {position, Block_Face_South, id, Block_Corner_Bottom_Right});
-        v->position += {0.5, -0.5, -0.5};
+        if (saved_count > 0)
+            glCopyBufferSubData (GL_ARRAY_BUFFER, GL_COPY_WRITE_BUFFER, sizeof (Vertex) * saved_start, 0, sizeof (Vertex) * saved_count);
 
-        v = array_push (vertices, {position, Block_Face_South, id, Block_Corner_Bottom_Left});
-        v->position += {-0.5, -0.5, -0.5};
+        if (grow)
+        {
+            // Leave some room so that the next edits of the chunk do not reallocate again
+            chunk->vbo_capacities[type] = new_count + new_count / 4;
+            glBufferData (GL_ARRAY_BUFFER, sizeof (Vertex) * chunk->vbo_capacities[type], null, GL_DYNAMIC_DRAW);
 
-        v = array_push (vertices, {position, Block_Face_South, id, Block_Corner_Top_Left});
-        v->position += {-0.5, 0.5, -0.5};
+            if (start > 0)
+                glCopyBufferSubData (GL_COPY_WRITE_BUFFER, GL_ARRAY_BUFFER, 0, 0, sizeof (Vertex) * start);
+        }
 
-        v = array_push (vertices, {position, Block_Face_South, id, Block_Corner_Top_Right});
-        v->position += {0.5, 0.5, -0.5};
+        if (old_count > old_end)
+        {
+            glCopyBufferSubData (
+                GL_COPY_WRITE_BUFFER, GL_ARRAY_BUFFER,
+                sizeof (Vertex) * (old_end - saved_start), sizeof (Vertex) * (start + vertices.count),
+                sizeof (Vertex) * (old_count - old_end)
+            );
+        }
+
+        glBindBuffer (GL_COPY_WRITE_BUFFER, 0);
     }
-}
 
-inline
-bool block_is_of_mesh_type (Block_Type block, Chunk_Mesh_Type mesh_type)
-{
-    switch (mesh_type)
+    if (vertices.count > 0)
+        glBufferSubData (GL_ARRAY_BUFFER, sizeof (Vertex) * start, sizeof (Vertex) * vertices.count, vertices.data);
+
+    glBindBuffer (GL_ARRAY_BUFFER, 0);
+
+    if (type == Chunk_Mesh_Water)
     {
-    case Chunk_Mesh_Solid:
-        return block != Block_Type_Water && block != Block_Type_Air;
-    case Chunk_Mesh_Water:
-        return block == Block_Type_Water;
-    default:
-        return false;
+        auto centers = &chunk->water_face_centers;
+        s64 first_face = start / 6;
+        s64 face_count = vertices.count / 6;
+        s64 tail_count = centers->count - old_end / 6;
+
+        if (first_face + face_count + tail_count > centers->capacity)
+            array_reserve (centers, first_face + face_count + tail_count);
+        memmove (centers->data + first_face + face_count, centers->data + old_end / 6, sizeof (Vec3f) * tail_count);
+        for_range (i, 0, face_count)
+            centers->data[first_face + i] = mesh_face_center (vertices.data + i * 6);
+
+        centers->count = first_face + face_count + tail_count;
+        chunk->water_sort_valid = false;
     }
+
+    s64 delta = vertices.count - (old_end - start);
+    for_range (s, first_section, end_section + 1)
+        offsets[s] = cast (u32) (start + section_offsets[s]);
+    for_range (s, end_section + 1, Chunk_Section_Count + 1)
+        offsets[s] = cast (u32) (offsets[s] + delta);
+
+    chunk->total_vertex_count += new_count - chunk->vertex_counts[type];
+    chunk->vertex_counts[type] = new_count;
 }
 
-void chunk_generate_mesh_data (Chunk *chunk, Array<Vertex> *vertices, Chunk_Mesh_Type type)
+// Meshes again the sections in Chunk.dirty_sections, from the lowest to the highest one, and
+// replaces their vertices in the meshes. Skirts depend on the whole column, so chunks that have
+// any are meshed entirely instead.
+void chunk_generate_section_meshes (Chunk *chunk)
 {
-    if (!chunk->is_dirty)
-       return;
+    if (!chunk->dirty_sections)
+        return;
 
-    Vec3f position = {cast (f32) chunk->x * Chunk_Size, 0, cast (f32) chunk->z * Chunk_Size};
-    for_range (x, 0, Chunk_Size)
+    bool skirts[6];
+    if (chunk_get_skirts (chunk, skirts))
     {
-        for_range (y, 0, Chunk_Height)
-        {
-            for_range (z, 0, Chunk_Size)
-            {
-                auto block = chunk_get_block_in_chunk (chunk, x, y, z);
-                if (!block_is_of_mesh_type (block.type, type))
-                    continue;
+        chunk->is_dirty = true;
+        chunk_generate_mesh_data (chunk);
 
-                Block_Face_Flags visible_faces = 0;
-                if (!block_is_of_mesh_type (chunk_get_block (chunk, x + 1, y, z).type, type))
-                    visible_faces |= Block_Face_Flag_East;
-                if (!block_is_of_mesh_type (chunk_get_block (chunk, x - 1, y, z).type, type))
-                    visible_faces |= Block_Face_Flag_West;
-                if (!block_is_of_mesh_type (chunk_get_block (chunk, x, y + 1, z).type, type))
-                    visible_faces |= Block_Face_Flag_Above;
-                if (!block_is_of_mesh_type (chunk_get_block (chunk, x, y - 1, z).type, type))
-                    visible_faces |= Block_Face_Flag_Below;
-                if (!block_is_of_mesh_type (chunk_get_block (chunk, x, y, z + 1).type, type))
-                    visible_faces |= Block_Face_Flag_North;
-                if (!block_is_of_mesh_type (chunk_get_block (chunk, x, y, z - 1).type, type))
-                    visible_faces |= Block_Face_Flag_South;
-
-                push_block (vertices, cast (u8) block.type, position + Vec3f{cast (f32) x, cast (f32) y, cast (f32) z}, visible_faces);
-            }
-        }
+        return;
     }
-}
 
-void chunk_generate_mesh_data (Chunk *chunk)
-{
-    if (!chunk->is_dirty)
-        return;
-    defer (chunk->is_dirty = false);
+    s64 first_section = 0;
+    while (!(chunk->dirty_sections & (1u << first_section)))
+        first_section += 1;
+
+    s64 end_section = Chunk_Section_Count;
+    while (!(chunk->dirty_sections & (1u << (end_section - 1))))
+        end_section -= 1;
+
+    chunk->dirty_sections = 0;
 
     auto state = arena_get_state (&frame_arena);
     defer (arena_set_state (&frame_arena, state));
 
+    // The layers right above and below the sections are needed to know which faces are visible
+    int section_cells = Chunk_Section_Height >> chunk->mesh_lod;
+    int first_layer = max (cast (int) first_section * section_cells - 1, 0);
+    int end_layer = min (cast (int) end_section * section_cells + 1, Chunk_Height >> chunk->mesh_lod);
+
+    Chunk_Lod_Grid grid;
+    chunk_build_lod_grid (chunk, chunk->mesh_lod, first_layer, end_layer, &grid, frame_allocator);
+
     Array<Vertex> vertices;
-    array_init (&vertices, frame_allocator, 12000);
+    array_init (&vertices, frame_allocator, 2048);
 
-    chunk->total_vertex_count = 0;
     for_range (i, 0, Chunk_Mesh_Count)
     {
-        chunk_generate_mesh_data (chunk, &vertices, cast (Chunk_Mesh_Type) i);
-        chunk->vertex_counts[i] = vertices.count;
-        chunk->total_vertex_count += vertices.count;
+        u32 section_offsets[Chunk_Section_Count + 1];
+        chunk_generate_mesh_data (chunk, &grid, skirts, first_section, end_section, &vertices, cast (Chunk_Mesh_Type) i, section_offsets);
 
-        glBindVertexArray (chunk->opengl_is_stupid_vaos[i]);
-        glBindBuffer (GL_ARRAY_BUFFER, chunk->gl_vbos[i]);
-
-        glBufferData (GL_ARRAY_BUFFER, sizeof (Vertex) * vertices.count, vertices.data, GL_DYNAMIC_DRAW);
+        // The vertical extent only grows, a slightly larger occlusion box is still correct
+        for_array (j, vertices)
+        {
+            chunk->mesh_y_range.x = min (chunk->mesh_y_range.x, vertices[j].position.y);
+            chunk->mesh_y_range.y = max (chunk->mesh_y_range.y, vertices[j].position.y);
+        }
 
-        glBindVertexArray (0);
-        glBindBuffer (GL_ARRAY_BUFFER, 0);
+        chunk_replace_section_vertices (chunk, cast (Chunk_Mesh_Type) i, first_section, end_section, vertices, section_offsets);
 
         array_clear (&vertices);
     }
@@ -776,14 +3061,30 @@ void init_default_spline (Terrain_Params *params)
     spline_push_value (spline_8856, 0.000000, 1.000000, spline_34440);
 }
 
-void world_init (World *world, s32 seed, int chunks_to_pre_generate, Terrain_Params terrain_params)
+void terrain_cache_init (Terrain_Cache *cache)
+{
+    hash_map_init (&cache->regions, hash_vec2i, compare_vec2i, heap_allocator ());
+    cache->use_counter = 0;
+    cache->generated_count = 0;
+    cache->hit_count = 0;
+}
+
+// Sets up everything the generation needs without creating any chunk, so it does
+// not make any GL call and can be used without a window (see world_pregenerate)
+void world_setup (World *world, s32 seed, Terrain_Params terrain_params)
 {
     memset (world, 0, sizeof (World));
 
     world->seed = seed;
+    world->random_key = splitmix64_mix (cast (u64) cast (s64) seed);
     world->terrain_params = terrain_params;
     if (!terrain_params.surface_spline)
         init_default_spline (&world->terrain_params);
+    if (!hermite_spline_compile (world->terrain_params.surface_spline, &world->surface_spline))
+        println ("[WORLD] Could not compile surface spline, it has too many splines or knots");
+    else if (world->terrain_params.bake_surface_spline)
+        surface_spline_lut_bake_all (world);
+
     cubiome::setupGenerator (&world->cubiome_gen, cubiome::MC_1_20, 0);
     cubiome::applySeed (&world->cubiome_gen, cubiome::DIM_OVERWORLD, seed);
 
@@ -794,8 +3095,23 @@ void world_init (World *world, s32 seed, int chunks_to_pre_generate, Terrain_Par
     perlin_generate_offsets (&rng, world->terrain_params.noise[0].octaves, world->noise_offsets[0]);
     perlin_generate_offsets (&rng, world->terrain_params.noise[1].octaves, world->noise_offsets[1]);
     perlin_generate_offsets (&rng, world->terrain_params.noise[2].octaves, world->noise_offsets[2]);
+    perlin_generate_offsets (&rng, world->terrain_params.density_noise.octaves, world->density_noise_offsets);
+
+    // The permutations come from their own stream, so adding them did not change the offsets
+    Counter_RNG permutation_rng;
+    random_seed (&permutation_rng, random_key_combine (world->random_key, cast (u64) 0x7065726d));
+    for_range (i, 0, 3)
+        perlin_generate_permutations (&permutation_rng, Perlin_Fractal_Max_Octaves, world->noise_permutations[i]);
+    perlin_generate_permutations (&permutation_rng, Perlin_Fractal_Max_Octaves, world->density_noise_permutations);
 
     hash_map_init (&world->all_loaded_chunks, hash_vec2i, compare_vec2i, heap_allocator ());
+    hash_map_init (&world->far_terrain_tiles, hash_vec2i, compare_vec2i, heap_allocator ());
+    terrain_cache_init (&world->terrain_cache);
+}
+
+void world_init (World *world, s32 seed, int chunks_to_pre_generate, Terrain_Params terrain_params)
+{
+    world_setup (world, seed, terrain_params);
 
     world->origin_chunk = world_create_chunk (world, 0, 0);
     chunk_generate (world, world->origin_chunk);
@@ -875,17 +3191,546 @@ void world_clear_chunks (World *world)
     }
 
     world->origin_chunk = null;
+
+    far_terrain_clear (world);
+    terrain_cache_clear (&world->terrain_cache);
+    surface_spline_lut_free (&world->surface_spline_lut);
 }
 
+// Returns air if the chunk is not loaded or does not have its blocks yet
 Block world_get_block (World *world, s64 x, s64 y, s64 z)
 {
-    s64 chunk_x = x / Chunk_Size;
-    s64 chunk_z = z / Chunk_Size;
+    auto chunk_position = chunk_position_from_block_position (x, z);
+    s64 chunk_x = chunk_position.x;
+    s64 chunk_z = chunk_position.y;
+
     auto chunk = world_get_chunk (world, chunk_x, chunk_z);
-    if (!chunk)
+    if (!chunk || chunk->stage < Chunk_Stage_Blocks)
         return Block_Air;
 
-    auto rel_xz = chunk_absolute_to_relative_coordinates (chunk, x, z);
+    return chunk_get_block_in_chunk (chunk, x - chunk_x * Chunk_Size, y, z - chunk_z * Chunk_Size);
+}
+
+// Same as chunk_get_height with world coordinates. Returns -1 if the chunk is not loaded
+// or does not have its blocks yet.
+s64 world_get_height (World *world, Heightmap_Type type, s64 x, s64 z)
+{
+    auto chunk_position = chunk_position_from_block_position (x, z);
+    s64 chunk_x = chunk_position.x;
+    s64 chunk_z = chunk_position.y;
+
+    auto chunk = world_get_chunk (world, chunk_x, chunk_z);
+    if (!chunk || chunk->stage < Chunk_Stage_Blocks)
+        return -1;
+
+    return chunk_get_height (chunk, type, x - chunk_x * Chunk_Size, z - chunk_z * Chunk_Size);
+}
+
+// Writes a block of the chunk and marks the sections whose mesh it changes as dirty: the
+// section of the block, the section next to it if the block is in the border cells of the
+// section, and the section of the neighbour if the block is in the border cells of the chunk.
+// Meshes are built from cells of (1 << mesh_lod) blocks, so the border is one cell wide, and
+// neighbours sample our border with their own cell size. Returns false if the block already
+// had this type.
+bool chunk_set_block (Chunk *chunk, s64 x, s64 y, s64 z, Block_Type type)
+{
+    assert (x >= 0 && x < Chunk_Size && y >= 0 && y < Chunk_Height && z >= 0 && z < Chunk_Size, "Bounds check failed (%lld, %lld, %lld)", x, y, z);
+
+    auto block = &chunk->blocks[chunk_block_index (x, y, z)];
+    if (block->type == type)
+        return false;
+
+    block->type = type;
+    chunk_update_heightmaps_at (chunk, x, y, z);
+
+    s64 section = y / Chunk_Section_Height;
+    u32 section_bit = 1u << section;
+    s64 step = 1 << chunk->mesh_lod;
+
+    chunk->dirty_sections |= section_bit;
+    if (y % Chunk_Section_Height < step && section > 0)
+        chunk->dirty_sections |= section_bit >> 1;
+    if (y % Chunk_Section_Height >= Chunk_Section_Height - step && section < Chunk_Section_Count - 1)
+        chunk->dirty_sections |= section_bit << 1;
+
+    if (chunk->east && x >= Chunk_Size - (1 << chunk->east->mesh_lod))
+        chunk->east->dirty_sections |= section_bit;
+    if (chunk->west && x < (1 << chunk->west->mesh_lod))
+        chunk->west->dirty_sections |= section_bit;
+    if (chunk->north && z >= Chunk_Size - (1 << chunk->north->mesh_lod))
+        chunk->north->dirty_sections |= section_bit;
+    if (chunk->south && z < (1 << chunk->south->mesh_lod))
+        chunk->south->dirty_sections |= section_bit;
+
+    return true;
+}
+
+void world_edit_begin (World_Edit *edit, World *world, Allocator allocator)
+{
+    edit->world = world;
+    array_init (&edit->chunks, allocator);
+}
+
+// Returns false if the chunk of the block is not loaded or has not reached the light stage,
+// in which case the block is left as it is
+bool world_edit_set_block (World_Edit *edit, s64 x, s64 y, s64 z, Block_Type type)
+{
+    if (y < 0 || y >= Chunk_Height)
+        return false;
+
+    auto chunk_position = chunk_position_from_block_position (x, z);
+    s64 chunk_x = chunk_position.x;
+    s64 chunk_z = chunk_position.y;
+
+    // Edits tend to be grouped, so the chunks already touched are looked up first
+    World_Edit_Chunk *entry = null;
+    for (s64 i = edit->chunks.count - 1; i >= 0; i -= 1)
+    {
+        if (edit->chunks[i].chunk->x == chunk_x && edit->chunks[i].chunk->z == chunk_z)
+        {
+            entry = &edit->chunks[i];
+
+            break;
+        }
+    }
+
+    if (!entry)
+    {
+        auto chunk = world_get_chunk (edit->world, chunk_x, chunk_z);
+        // Earlier stages may still have neighbour feature edits to apply over the block
+        if (!chunk || chunk->stage < Chunk_Stage_Light)
+            return false;
+
+        entry = array_push (&edit->chunks, {chunk, 0});
+    }
+
+    if (chunk_set_block (entry->chunk, x - chunk_x * Chunk_Size, y, z - chunk_z * Chunk_Size, type))
+        entry->touched_sections |= 1u << (y / Chunk_Section_Height);
+
+    return true;
+}
+
+// Updates the section types of the touched sections and frees the edit. The meshes of the
+// dirty sections are generated again by world_draw_chunks.
+void world_edit_commit (World_Edit *edit)
+{
+    for_array (i, edit->chunks)
+    {
+        auto chunk = edit->chunks[i].chunk;
+        for_range (s, 0, Chunk_Section_Count)
+        {
+            if (edit->chunks[i].touched_sections & (1u << s))
+                chunk_update_section_types (chunk, s, s + 1);
+        }
+    }
+
+    array_free (&edit->chunks);
+}
+
+bool world_set_block (World *world, s64 x, s64 y, s64 z, Block_Type type)
+{
+    World_Edit edit;
+    world_edit_begin (&edit, world, frame_allocator);
+    defer (world_edit_commit (&edit));
+
+    return world_edit_set_block (&edit, x, y, z, type);
+}
+
+// Walks the blocks crossed by the ray one at a time and returns the first solid one within
+// max_distance. direction must be normalized. normal is set to the face the ray entered the
+// block through, so a block placed against the hit face goes at hit + normal.
+bool world_raycast_block (World *world, Vec3f origin, Vec3f direction, f32 max_distance, Vec3l *hit, Vec3l *normal)
+{
+    // Blocks are centered on integer positions, shifting the origin puts their faces on integers
+    Vec3f start = origin + Vec3f{0.5f, 0.5f, 0.5f};
+    Vec3l block = {cast (s64) floorf (start.x), cast (s64) floorf (start.y), cast (s64) floorf (start.z)};
+
+    Vec3l step;
+    Vec3f next_distance;    // Distance along the ray to the next face crossed on each axis
+    Vec3f face_distance;    // Distance along the ray between two faces on each axis
+    for_range (i, 0, 3)
+    {
+        if (direction[i] > 0)
+        {
+            step[i] = 1;
+            next_distance[i] = (block[i] + 1 - start[i]) / direction[i];
+            face_distance[i] = 1 / direction[i];
+        }
+        else if (direction[i] < 0)
+        {
+            step[i] = -1;
+            next_distance[i] = (block[i] - start[i]) / direction[i];
+            face_distance[i] = -1 / direction[i];
+        }
+        else
+        {
+            step[i] = 0;
+            next_distance[i] = F32_MAX;
+            face_distance[i] = F32_MAX;
+        }
+    }
+
+    *normal = {};
+    f32 distance = 0;
+    while (distance <= max_distance)
+    {
+        if (block_is_of_mesh_type (world_get_block (world, block.x, block.y, block.z).type, Chunk_Mesh_Solid))
+        {
+            *hit = block;
+
+            return true;
+        }
+
+        int axis = 0;
+        if (next_distance[1] < next_distance[axis])
+            axis = 1;
+        if (next_distance[2] < next_distance[axis])
+            axis = 2;
+
+        distance = next_distance[axis];
+        next_distance[axis] += face_distance[axis];
+        block[axis] += step[axis];
+
+        *normal = {};
+        (*normal)[axis] = -step[axis];
+    }
+
+    return false;
+}
+
+static_assert (sizeof (Block) == 1, "Region files store blocks as one byte");
+
+// The fields are written one by one so the file does not depend on the padding of the struct
+bool region_file_write_header (FILE *file, const Region_File_Header &header)
+{
+    return fwrite (&header.magic, sizeof (u32), 1, file) == 1
+        && fwrite (&header.version, sizeof (u32), 1, file) == 1
+        && fwrite (&header.region_x, sizeof (s32), 1, file) == 1
+        && fwrite (&header.region_z, sizeof (s32), 1, file) == 1
+        && fwrite (&header.chunk_count, sizeof (u32), 1, file) == 1;
+}
+
+bool region_file_write_chunk_header (FILE *file, const Region_File_Chunk_Header &header)
+{
+    return fwrite (&header.x, sizeof (s32), 1, file) == 1
+        && fwrite (&header.z, sizeof (s32), 1, file) == 1
+        && fwrite (&header.stage, sizeof (u8), 1, file) == 1
+        && fwrite (header.section_types, sizeof (u8), Chunk_Section_Count, file) == Chunk_Section_Count;
+}
+
+bool region_file_write (const char *filename, s64 region_x, s64 region_z, s64 chunk_count, const Chunk *const *chunks)
+{
+    static const s64 Section_Block_Count = Chunk_Size * Chunk_Size * Chunk_Section_Height;
+
+    FILE *file = fopen (filename, "wb");
+    if (!file)
+        return false;
+
+    defer (fclose (file));
+
+    Region_File_Header header = {};
+    header.magic = Region_File_Magic;
+    header.version = Region_File_Version;
+    header.region_x = cast (s32) region_x;
+    header.region_z = cast (s32) region_z;
+    header.chunk_count = cast (u32) chunk_count;
+
+    if (!region_file_write_header (file, header))
+        return false;
+
+    for_range (i, 0, chunk_count)
+    {
+        auto chunk = chunks[i];
+
+        Region_File_Chunk_Header chunk_header = {};
+        chunk_header.x = cast (s32) chunk->x;
+        chunk_header.z = cast (s32) chunk->z;
+        chunk_header.stage = cast (u8) chunk->stage;
+        for_range (s, 0, Chunk_Section_Count)
+            chunk_header.section_types[s] = cast (u8) chunk->section_types[s];
+
+        if (!region_file_write_chunk_header (file, chunk_header))
+            return false;
+
+        if (fwrite (chunk->heightmaps, sizeof (chunk->heightmaps), 1, file) != 1)
+            return false;
+
+        // Sections made of a single type of block are entirely described by their type
+        for_range (s, 0, Chunk_Section_Count)
+        {
+            if (chunk->section_types[s] != Block_Type_Count)
+                continue;
+
+            if (fwrite (&chunk->blocks[s * Section_Block_Count], sizeof (Block), Section_Block_Count, file) != Section_Block_Count)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+struct World_Pregen_Job
+{
+    World *world;
+    const char *directory;
+    s64 chunk_radius;
+    s64 first_region_x, first_region_z;
+    s64 region_count_x, region_count_z;
+    int thread_index;
+    int thread_count;
+
+    s64 chunk_count;
+    s64 region_count;
+    s64 failed_write_count;
+    s64 stage_times[Chunk_Stage_Count];
+    s64 write_time;
+};
+
+s32 world_pregen_thread_proc (Thread *thread)
+{
+    auto job = cast (World_Pregen_Job *) thread->data;
+    auto world = job->world;
+
+    // The generation code allocates its temporary buffers from the frame arena of the
+    // thread, which is already set up if the job runs on the main thread
+    bool owns_frame_arena = frame_arena.default_page_size == 0;
+    if (owns_frame_arena)
+    {
+        if (!arena_init (&frame_arena, 4096, heap_allocator ()))
+            return 1;
+
+        frame_allocator = arena_allocator (&frame_arena);
+    }
+
+    defer (if (owns_frame_arena) arena_reset (&frame_arena));
+
+    // The chunks of the region and a ring of one chunk around it, whose features can reach
+    // into the region. The ring is generated by the threads of all the regions it touches.
+    static const int Grid_Size = Terrain_Region_Size + 2;
+    static const int Grid_Width = Grid_Size * Chunk_Size;
+
+    auto values = mem_alloc_uninit (Terrain_Values, Grid_Width * Grid_Width, heap_allocator ());
+    defer (mem_free (values, heap_allocator ()));
+
+    auto grid = mem_alloc_uninit (Chunk, Grid_Size * Grid_Size, heap_allocator ());
+    defer (mem_free (grid, heap_allocator ()));
+
+    Chunk *grid_chunks[Grid_Size * Grid_Size];
+    const Chunk *region_chunks[Terrain_Region_Size * Terrain_Region_Size];   // The chunks of the region in the area
+
+    // Regions are interleaved between the threads, so that the more expensive areas of
+    // the world are spread among them
+    s64 total_region_count = job->region_count_x * job->region_count_z;
+    for (s64 i = job->thread_index; i < total_region_count; i += job->thread_count)
+    {
+        s64 region_x = job->first_region_x + i / job->region_count_z;
+        s64 region_z = job->first_region_z + i % job->region_count_z;
+        s64 grid_x = region_x * Terrain_Region_Size - 1;
+        s64 grid_z = region_z * Terrain_Region_Size - 1;
+
+        // The values are generated for the whole grid at once, but not through the world's
+        // terrain cache, which is not thread safe
+        s64 start_time = time_current_monotonic ();
+        terrain_values_generate (world, grid_x * Chunk_Size, grid_z * Chunk_Size, Grid_Width, values);
+        job->stage_times[Chunk_Stage_Terrain_Values] += time_current_monotonic () - start_time;
+
+        for_range (local_x, 0, Grid_Size)
+        {
+            for_range (local_z, 0, Grid_Size)
+            {
+                s64 chunk_x = grid_x + local_x;
+                s64 chunk_z = grid_z + local_z;
+
+                grid_chunks[local_x * Grid_Size + local_z] = null;
+
+                // Skip the chunks that are not in the area and not next to it
+                if (chunk_x < -job->chunk_radius - 1 || chunk_x > job->chunk_radius
+                 || chunk_z < -job->chunk_radius - 1 || chunk_z > job->chunk_radius)
+                    continue;
+
+                // The chunks never get to the mesh stage, so they do not need GL objects
+                auto chunk = &grid[local_x * Grid_Size + local_z];
+                chunk_clear_fields (chunk);
+                chunk->x = chunk_x;
+                chunk->z = chunk_z;
+                for_range (n, 0, Chunk_Neighbour_Count)
+                    array_init (&chunk->outgoing_edits[n], heap_allocator ());
+
+                grid_chunks[local_x * Grid_Size + local_z] = chunk;
+
+                // Link the chunk like world_create_chunk does, the chunks at greater
+                // coordinates link themselves when they are created
+                if (local_x > 0 && grid_chunks[(local_x - 1) * Grid_Size + local_z])
+                {
+                    chunk->west = grid_chunks[(local_x - 1) * Grid_Size + local_z];
+                    chunk->west->east = chunk;
+                }
+                if (local_z > 0 && grid_chunks[local_x * Grid_Size + local_z - 1])
+                {
+                    chunk->south = grid_chunks[local_x * Grid_Size + local_z - 1];
+                    chunk->south->north = chunk;
+                }
+
+                terrain_region_copy_chunk_values (values, Grid_Width, local_x, local_z, chunk->terrain_values);
+                chunk->stage = Chunk_Stage_Terrain_Values;
+
+                // Run the stages that do not depend on the neighbours
+                while (chunk->stage < Chunk_Stage_Features)
+                {
+                    auto next = cast (Chunk_Stage) (chunk->stage + 1);
+                    assert (chunk_stage_neighbour_requirement (next) == Chunk_Stage_Empty);
+
+                    start_time = time_current_monotonic ();
+                    chunk_run_stage (world, chunk, next);
+                    job->stage_times[next] += time_current_monotonic () - start_time;
+                }
+            }
+        }
+
+        s64 chunk_count = 0;
+        for_range (local_x, 1, Grid_Size - 1)
+        {
+            for_range (local_z, 1, Grid_Size - 1)
+            {
+                auto chunk = grid_chunks[local_x * Grid_Size + local_z];
+                if (!chunk || chunk->x < -job->chunk_radius || chunk->x >= job->chunk_radius
+                 || chunk->z < -job->chunk_radius || chunk->z >= job->chunk_radius)
+                    continue;
+
+                assert (chunk_neighbours_reached_stage (chunk, chunk_stage_neighbour_requirement (Chunk_Stage_Light)));
+
+                start_time = time_current_monotonic ();
+                chunk_run_stage (world, chunk, Chunk_Stage_Light);
+                job->stage_times[Chunk_Stage_Light] += time_current_monotonic () - start_time;
+
+                region_chunks[chunk_count] = chunk;
+                chunk_count += 1;
+            }
+        }
+
+        String_Builder builder;
+        string_builder_init (&builder, heap_allocator ());
+        string_builder_append (&builder, "%s/r.%lld.%lld.region", job->directory, region_x, region_z);
+        char *filename = string_builder_build_cstr (&builder, heap_allocator ());
+        defer (mem_free (filename, heap_allocator ()));
+
+        start_time = time_current_monotonic ();
+        if (!region_file_write (filename, region_x, region_z, chunk_count, region_chunks))
+            job->failed_write_count += 1;
+        job->write_time += time_current_monotonic () - start_time;
+
+        for_range (g, 0, Grid_Size * Grid_Size)
+        {
+            if (!grid_chunks[g])
+                continue;
+
+            for_range (n, 0, Chunk_Neighbour_Count)
+                array_free (&grid_chunks[g]->outgoing_edits[n]);
+        }
+
+        job->chunk_count += chunk_count;
+        job->region_count += 1;
+    }
+
+    return 0;
+}
+
+// Generates the chunks in [-chunk_radius; chunk_radius) on both axes with thread_count threads,
+// and writes them to one region file per Terrain_Region in directory. Nothing is added to the
+// world and no GL call is made, so it can run without a window. The timings are printed to the console.
+bool world_pregenerate (World *world, s64 chunk_radius, int thread_count, const char *directory)
+{
+    static const int Max_Threads = 64;
+    // There is no lighting yet, the light stage only applies the feature edits of the neighbours
+    static const char *Chunk_Stage_Names[Chunk_Stage_Count] = {
+        "Empty", "Terrain values", "Blocks", "Surface", "Features", "Feature edits", "Mesh"
+    };
+
+    if (!create_directory (string_make (directory)))
+    {
+        println ("[PREGEN] Could not create directory %s", directory);
+        return false;
+    }
+
+    chunk_radius = max (chunk_radius, cast (s64) 1);
+
+    s64 first_region_x = terrain_region_coordinate (-chunk_radius, Terrain_Region_Size);
+    s64 last_region_x = terrain_region_coordinate (chunk_radius - 1, Terrain_Region_Size);
+    s64 region_count = last_region_x - first_region_x + 1;
+
+    thread_count = cast (int) clamp (cast (s64) thread_count, cast (s64) 1, min (region_count * region_count, cast (s64) Max_Threads));
+
+    World_Pregen_Job jobs[Max_Threads] = {};
+    Thread threads[Max_Threads];
+    Thread *thread_ptrs[Max_Threads];
+
+    for_range (i, 0, thread_count)
+    {
+        jobs[i].world = world;
+        jobs[i].directory = directory;
+        jobs[i].chunk_radius = chunk_radius;
+        jobs[i].first_region_x = first_region_x;
+        jobs[i].first_region_z = first_region_x;
+        jobs[i].region_count_x = region_count;
+        jobs[i].region_count_z = region_count;
+        jobs[i].thread_index = cast (int) i;
+        jobs[i].thread_count = thread_count;
+    }
+
+    s64 start_time = time_current_monotonic ();
+
+    int started_count = 0;
+    for_range (i, 0, thread_count)
+    {
+        if (!thread_init (&threads[i], world_pregen_thread_proc, &jobs[i]))
+        {
+            // Do the work of the threads that could not be created on this one
+            Thread thread = {};
+            thread.data = &jobs[i];
+            world_pregen_thread_proc (&thread);
+
+            continue;
+        }
+
+        thread_ptrs[started_count] = &threads[i];
+        started_count += 1;
+        thread_start (&threads[i]);
+    }
+
+    thread_wait_multiple (slice_make (cast (s64) started_count, thread_ptrs));
+
+    for_range (i, 0, started_count)
+        thread_cleanup (thread_ptrs[i]);
+
+    s64 total_time = time_current_monotonic () - start_time;
+
+    World_Pregen_Job total = {};
+    for_range (i, 0, thread_count)
+    {
+        total.chunk_count += jobs[i].chunk_count;
+        total.region_count += jobs[i].region_count;
+        total.failed_write_count += jobs[i].failed_write_count;
+        total.write_time += jobs[i].write_time;
+        for_range (s, 0, Chunk_Stage_Count)
+            total.stage_times[s] += jobs[i].stage_times[s];
+    }
+
+    println ("[PREGEN] Generated %lld chunks in %lld regions with %d threads in %.2f s, %.1f chunks/s",
+        total.chunk_count, total.region_count, thread_count, total_time / 1000000.0, total.chunk_count / max (total_time / 1000000.0, 0.000001));
+
+    // The stage timings are summed over all the threads
+    for_range (s, 0, Chunk_Stage_Count)
+    {
+        if (total.stage_times[s] > 0)
+            println ("  %-15s %.3f ms/chunk", Chunk_Stage_Names[s], total.stage_times[s] / 1000.0 / max (total.chunk_count, cast (s64) 1));
+    }
+    println ("  %-15s %.3f ms/chunk", "Write", total.write_time / 1000.0 / max (total.chunk_count, cast (s64) 1));
+
+    if (total.failed_write_count > 0)
+    {
+        println ("[PREGEN] Could not write %lld region files to %s", total.failed_write_count, directory);
+        return false;
+    }
 
-    return chunk_get_block_in_chunk (chunk, rel_xz.x, y, rel_xz.y);
+    return true;
 }